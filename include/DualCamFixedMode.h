@@ -0,0 +1,122 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// Author: Peng Hao
+// License: GPL
+//////////////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////////////
+// @file: DualCamFixedMode.h
+// @brief: compile time specialized paste for fixed camera modes
+//////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include "DualCamSynthesis.h"
+
+#define DCS_MAX_FIXED_MODE 64
+
+struct DCS_FIXED_MODE {
+	uint32_t backW;
+	uint32_t backH;
+	uint32_t pipW;
+	uint32_t pipH;
+	uint32_t format;
+	int32_t mirrorFlipState;
+	DCS_FIXED_PASTE_FUNC paste;
+};
+
+// register before Initialize()/SetParams() of the engines which should use it
+int32_t RegisterFixedMode(DCS_FIXED_MODE mode);
+DCS_FIXED_PASTE_FUNC FindFixedMode(uint32_t backW, uint32_t backH,
+	uint32_t pipW, uint32_t pipH, uint32_t format, int32_t mirrorFlipState);
+
+// Same result as SynthesisEngine::ProcessSynthesis() for packed planes, but every
+// stride, offset and loop trip count is a constant, so the compiler can unroll and
+// vectorize. Only the target point is a runtime value.
+// FORMAT does not change the paste, UV pairs are copied as they are for NV12 and
+// NV21 alike. It is only carried into GetMode() to key the registry lookup.
+template <uint32_t BACK_W, uint32_t BACK_H, uint32_t PIP_W, uint32_t PIP_H,
+	uint32_t FORMAT, int32_t MIRROR>
+class FixedModeEngine {
+
+public:
+	static_assert(PIP_W <= BACK_W && PIP_H <= BACK_H, "PiP must fit in back image");
+	static_assert(FORMAT < DCS_NOT_SUPPORT, "format not support");
+
+	// constant size blocks are inlined as vector moves, a whole constant row may
+	// become rep movs which is slower than the library memcpy
+	static inline void CopyRow(uint8_t* dst, const uint8_t* src)
+	{
+		uint32_t col = 0;
+		for (; col + 64 <= PIP_W; col += 64) {
+			memcpy(dst + col, src + col, 64);
+		}
+		for (; col < PIP_W; col++) {
+			dst[col] = src[col];
+		}
+	}
+
+	// reversed copy of bpp byte pixels, 8 bytes at a time. the shifts are
+	// recognized as one byte swap instruction
+	template <uint32_t BPP>
+	static inline void MirrorRow(uint8_t* dst, const uint8_t* srcEnd, uint32_t width)
+	{
+		uint32_t col = 0;
+		for (; col + 8 <= width; col += 8) {
+			uint64_t v;
+			memcpy(&v, srcEnd - col - 8, 8);
+			v = (v >> 32) | (v << 32);
+			v = ((v >> 16) & 0x0000ffff0000ffffULL) | ((v & 0x0000ffff0000ffffULL) << 16);
+			if (BPP == 1) {
+				v = ((v >> 8) & 0x00ff00ff00ff00ffULL) | ((v & 0x00ff00ff00ff00ffULL) << 8);
+			}
+			memcpy(dst + col, &v, 8);
+		}
+		for (; col < width; col += BPP) {
+			for (uint32_t c = 0; c < BPP; c++) {
+				dst[col + c] = srcEnd[-(int32_t)(col + BPP) + (int32_t)c];
+			}
+		}
+	}
+
+	static void Paste(uint8_t* frontY, uint8_t* frontUV,
+		uint8_t* backY, uint8_t* backUV, uint32_t x, uint32_t y)
+	{
+		// UV of an odd target column starts one byte earlier, as in the generic path
+		uint8_t* dstY = backY + y * BACK_W + x;
+		uint8_t* dstUV = backUV + y / 2 * BACK_W + x - x % 2;
+
+		for (uint32_t row = 0; row < PIP_H; row++) {
+			if (MIRROR == NEED_X_MIRROR) {
+				MirrorRow<1>(dstY + row * BACK_W, frontY + (row + 1) * PIP_W, PIP_W);
+				if (row % 2 == 0) {
+					MirrorRow<2>(dstUV + row / 2 * BACK_W, frontUV + (row / 2 + 1) * PIP_W, PIP_W);
+				}
+			}
+			else if (MIRROR == NEED_Y_FLIP) {
+				CopyRow(backY + (y + PIP_H - row - 1) * BACK_W + x, frontY + row * PIP_W);
+				if (row % 2 == 0) {
+					CopyRow(backUV + ((y + PIP_H - row) / 2 - 1) * BACK_W + x - x % 2,
+						frontUV + row / 2 * PIP_W);
+				}
+			}
+			else if (MIRROR == NEED_BOTH) {
+				MirrorRow<1>(dstY + row * BACK_W, frontY + (PIP_H - row) * PIP_W, PIP_W);
+				if (row % 2 == 0) {
+					MirrorRow<2>(dstUV + row / 2 * BACK_W,
+						frontUV + (PIP_H - row - 1) / 2 * PIP_W + PIP_W, PIP_W);
+				}
+			}
+			else {
+				CopyRow(dstY + row * BACK_W, frontY + row * PIP_W);
+				if (row % 2 == 0) {
+					CopyRow(dstUV + row / 2 * BACK_W, frontUV + row / 2 * PIP_W);
+				}
+			}
+		}
+	}
+
+	static DCS_FIXED_MODE GetMode()
+	{
+		DCS_FIXED_MODE mode = { BACK_W, BACK_H, PIP_W, PIP_H, FORMAT, MIRROR, &Paste };
+		return mode;
+	}
+};
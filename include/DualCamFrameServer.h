@@ -0,0 +1,91 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// Author: Peng Hao
+// License: GPL
+//////////////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////////////
+// @file: DualCamFrameServer.h
+// @brief: head file for class FrameServer, Linux only (memfd + eventfd)
+//////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <atomic>
+#include "DualCamSynthesis.h"
+
+#define DCS_SERVER_MAX_SLOT 16
+#define DCS_SERVER_MAGIC 0x44435353    //"DCSS"
+
+// One single producer/single consumer ring in shared memory.
+// front ring: capture -> head, server -> tail.
+// back ring:  capture -> head, server -> composed, encoder -> tail,
+//             so the encoder reads the composited back slot in place.
+struct DCS_SHM_RING {
+	alignas(64) std::atomic<uint32_t> head;
+	alignas(64) std::atomic<uint32_t> composed;
+	alignas(64) std::atomic<uint32_t> tail;
+	uint32_t slotNum;
+	uint32_t slotSize;
+	uint64_t offset;          //first slot, from the start of shared memory
+	uint64_t timestamp[DCS_SERVER_MAX_SLOT];
+};
+
+struct DCS_SHM_HEADER {
+	uint32_t magic;
+	uint64_t size;
+	DUAL_CAM_SYNTHESIS_PARAM param;
+	DCS_SHM_RING front;
+	DCS_SHM_RING back;
+};
+
+// every process maps the server through these, e.g. inherited or sent by SCM_RIGHTS.
+// front frames need no wakeup, the server only looks at them when a back frame comes
+struct DCS_SERVER_FDS {
+	int32_t memFd;
+	int32_t backEvent;        //capture -> server
+	int32_t outputEvent;      //server -> encoder
+};
+
+class FrameServer {
+
+public:
+	FrameServer();
+	~FrameServer();
+
+	// server side, engine has to be initialized
+	int32_t Create(SynthesisEngine* engine, uint32_t slotNum);
+	// wait for back frames and composite all of them, timeoutMs < 0 waits forever
+	int32_t ProcessOnce(int32_t timeoutMs);
+
+	// client side
+	int32_t Attach(DCS_SERVER_FDS fds);
+	int32_t GetFds(DCS_SERVER_FDS* fds);
+	int32_t GetParams(DUAL_CAM_SYNTHESIS_PARAM* param);
+	int32_t Destroy();
+
+	// capture side, returns nullptr when the ring is full
+	uint8_t* AcquireFrontSlot();
+	int32_t SubmitFront(uint64_t timestamp);
+	uint8_t* AcquireBackSlot();
+	int32_t SubmitBack(uint64_t timestamp);
+
+	// encoder side, returns nullptr on timeout
+	uint8_t* AcquireOutput(int32_t timeoutMs, uint64_t* timestamp);
+	int32_t ReleaseOutput();
+
+	bool mInited;
+
+private:
+	int32_t Map(int32_t memFd);
+	bool CheckRing(DCS_SHM_RING* ring);
+	uint8_t* GetSlot(DCS_SHM_RING* ring, uint32_t index);
+	int32_t WaitEvent(int32_t eventFd, int32_t timeoutMs);
+	void SignalEvent(int32_t eventFd);
+
+	bool mIsServer;
+	DCS_SERVER_FDS mFds;
+	DCS_SHM_HEADER* mHeader;
+	uint8_t* mBase;
+	uint64_t mMapSize;        //from fstat, mHeader->size is not trusted by a client
+	SynthesisEngine* mEngine;
+	bool mFrontScaled;        //front slot at front.tail is scaled and kept for reuse
+};
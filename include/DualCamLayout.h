@@ -0,0 +1,100 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// Author: Peng Hao
+// License: GPL
+//////////////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////////////
+// @file: DualCamLayout.h
+// @brief: head file for class LayoutEngine
+//////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "DualCamSynthesis.h"
+
+#define DCS_LAYOUT_MAX_SOURCE 4
+
+enum DUAL_CAM_LAYOUT_MODE {
+	DCS_LAYOUT_SIDE_BY_SIDE = 0,    //left | right
+	DCS_LAYOUT_TOP_BOTTOM,
+	DCS_LAYOUT_GRID_2X2,            //up to 4 sources, empty cells are black
+	DCS_LAYOUT_NOT_SUPPORT,
+};
+
+enum DUAL_CAM_LAYOUT_FIT {
+	DCS_FIT_LETTERBOX = 0,          //keep aspect, black borders
+	DCS_FIT_CROP,                   //keep aspect, cut source center
+	DCS_FIT_STRETCH,
+	DCS_FIT_NOT_SUPPORT,
+};
+
+struct DUAL_CAM_LAYOUT_PARAM {
+	uint32_t mode;
+	uint32_t fit;
+	uint32_t sourceNum;
+	IMG_INFO sourceInfo[DCS_LAYOUT_MAX_SOURCE];
+	IMG_INFO outputInfo;
+};
+
+struct DCS_LAYOUT_REGION {
+	uint32_t x;          //cell in output
+	uint32_t y;
+	uint32_t width;
+	uint32_t height;
+	uint32_t outX;       //scaled image inside the cell
+	uint32_t outY;
+	uint32_t outW;
+	uint32_t outH;
+	uint32_t cropX;      //used part of the source
+	uint32_t cropY;
+	uint32_t cropW;
+	uint32_t cropH;
+};
+
+// Scale every source straight into its cell of a new output frame, no
+// intermediate buffer. Cells are scaled concurrently by persistent workers,
+// one per source but the first, started in Initialize().
+class LayoutEngine {
+
+public:
+	LayoutEngine();
+	~LayoutEngine();
+
+	int32_t SetParams(DUAL_CAM_LAYOUT_PARAM param);
+	int32_t Initialize();
+	int32_t Deinit();
+	// must be set before Initialize()
+	int32_t SetParallel(bool enable);
+	// sourceData[i] is a contiguous NV12/NV21 frame of sourceInfo[i]
+	int32_t ProcessLayout(void** sourceData, void* outputData);
+
+	bool mInited;
+
+private:
+	int32_t CheckParams();
+	void ComputeRegion(uint32_t cell);
+	void WorkerLoop(uint32_t index);
+	void StopWorkers();
+	int32_t ProcessRegion(uint32_t index, uint8_t* src, uint8_t* dst);
+	void FillBlack(uint8_t* dst, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+
+	bool mParamValid;
+	bool mParallel;
+	DUAL_CAM_LAYOUT_PARAM mParam;
+	DCS_LAYOUT_REGION mRegion[DCS_LAYOUT_MAX_SOURCE];
+	uint32_t mCellNum;
+
+	std::thread mWorker[DCS_LAYOUT_MAX_SOURCE];
+	uint32_t mWorkerNum;
+	std::mutex mLock;
+	std::condition_variable mStartCond;
+	std::condition_variable mDoneCond;
+	bool mStop;
+	uint32_t mGeneration;     //bumped for every frame handed to the workers
+	uint32_t mPending;        //workers not done with current frame
+	uint8_t* mFrameSrc[DCS_LAYOUT_MAX_SOURCE];
+	uint8_t* mFrameDst;
+	int32_t mCellResult[DCS_LAYOUT_MAX_SOURCE];
+};
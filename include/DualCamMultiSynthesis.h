@@ -0,0 +1,53 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// Author: Peng Hao
+// License: GPL
+//////////////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////////////
+// @file: DualCamMultiSynthesis.h
+// @brief: head file for class MultiSynthesisEngine
+//////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include "DualCamSynthesis.h"
+
+#define DCS_MAX_OUTPUT_NUM 4
+#define DCS_MAX_PYRAMID_LEVEL 8
+
+// Composite one front frame into several back frames of different sizes.
+// The front is halved into a pyramid once per frame, and every output scales
+// its PiP from the smallest level which is still bigger than the PiP.
+class MultiSynthesisEngine {
+
+public:
+	MultiSynthesisEngine();
+	~MultiSynthesisEngine();
+
+	int32_t SetFrontParams(IMG_INFO frontInfo);
+	int32_t AddOutput(IMG_INFO frontScaledInfo, IMG_INFO backInfo, BEGIN_POINT targetPoint);
+	int32_t Initialize();
+	int32_t Deinit();
+	// backData[i] is the back frame of the i-th added output, front is not modified
+	int32_t ProcessSynthesis(void* frontData, void** backData, uint32_t backNum);
+	int32_t UpdateTargetPoint(uint32_t index, BEGIN_POINT point);
+
+	bool mInited;
+
+private:
+	int32_t BuildPyramid(uint8_t* frontData);
+
+	IMG_INFO mFrontInfo;
+	bool mFrontValid;
+	uint32_t mOutputNum;
+	DUAL_CAM_SYNTHESIS_PARAM mOutputParam[DCS_MAX_OUTPUT_NUM];
+	SynthesisEngine mEngine[DCS_MAX_OUTPUT_NUM];
+	uint32_t mOutputLevel[DCS_MAX_OUTPUT_NUM];
+
+	uint32_t mLevelNum;
+	uint32_t mLevelW[DCS_MAX_PYRAMID_LEVEL];
+	uint32_t mLevelH[DCS_MAX_PYRAMID_LEVEL];
+	uint8_t* mLevelY[DCS_MAX_PYRAMID_LEVEL];
+	uint8_t* mLevelUV[DCS_MAX_PYRAMID_LEVEL];
+	uint8_t* mPyramidBuf;   //level 1 and below, level 0 is the input front
+	uint8_t* mPipBuf;       //shared by all outputs, sized for the biggest PiP
+};
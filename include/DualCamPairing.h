@@ -0,0 +1,87 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// Author: Peng Hao
+// License: GPL
+//////////////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////////////
+// @file: DualCamPairing.h
+// @brief: head file for class PairingScheduler
+//////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <mutex>
+#include "DualCamSynthesis.h"
+
+#define DCS_PAIRING_QUEUE_SIZE 8
+
+// called when the scheduler gives a front/back frame back to its owner.
+// dropped is true if the frame was never used.
+typedef void (*DCS_FRAME_RELEASE_FUNC)(void* data, uint64_t timestamp,
+	bool dropped, void* userData);
+
+struct DUAL_CAM_PAIRING_PARAM {
+	uint64_t tolerance;       //max |front - back| timestamp distance of a pair
+	uint64_t latencyBudget;   //back frames older than newest back - budget are dropped
+};
+
+struct DUAL_CAM_PAIRING_STATS {
+	uint32_t frontQueueDepth;
+	uint32_t backQueueDepth;
+	uint32_t frontDropped;
+	uint32_t backDropped;
+	uint32_t paired;
+	uint32_t frontStale;      //paired with a front older than tolerance, the newest one there was
+	uint32_t frontReused;     //back composited with last scaled front
+	uint32_t noFront;         //back given out without PiP, no front scaled yet
+};
+
+// Pairs unsynchronized front/back frames by timestamp in front of a SynthesisEngine.
+// Push may be called from the sensor threads, ProcessNext from one consumer thread.
+class PairingScheduler {
+
+public:
+	PairingScheduler();
+	~PairingScheduler();
+
+	int32_t Initialize(SynthesisEngine* engine, DUAL_CAM_PAIRING_PARAM param,
+		DCS_FRAME_RELEASE_FUNC releaseFunc, void* userData);
+	int32_t Deinit();
+	int32_t PushFront(void* data, uint64_t timestamp);
+	int32_t PushBack(void* data, uint64_t timestamp);
+	// composite the oldest fresh back frame, its ownership goes back to the caller.
+	// on error *backData is nullptr, a popped back frame is released as dropped
+	int32_t ProcessNext(void** backData, uint64_t* timestamp);
+	int32_t GetStats(DUAL_CAM_PAIRING_STATS* stats);
+
+	bool mInited;
+
+private:
+	struct FRAME_ENTRY {
+		void* data;
+		uint64_t timestamp;
+	};
+
+	int32_t PushLocked(FRAME_ENTRY* queue, uint32_t* head, uint32_t* count,
+		uint32_t* dropped, void* data, uint64_t timestamp, FRAME_ENTRY* evicted);
+	FRAME_ENTRY Pop(FRAME_ENTRY* queue, uint32_t* head, uint32_t* count);
+	// never called with mLock held, the callback may push again
+	void Release(FRAME_ENTRY entry, bool dropped);
+
+	SynthesisEngine* mEngine;
+	DUAL_CAM_PAIRING_PARAM mParam;
+	DUAL_CAM_PAIRING_STATS mStats;
+	DCS_FRAME_RELEASE_FUNC mReleaseFunc;
+	void* mUserData;
+	std::mutex mLock;
+
+	FRAME_ENTRY mFrontQueue[DCS_PAIRING_QUEUE_SIZE];
+	uint32_t mFrontHead;
+	uint32_t mFrontCount;
+	FRAME_ENTRY mBackQueue[DCS_PAIRING_QUEUE_SIZE];
+	uint32_t mBackHead;
+	uint32_t mBackCount;
+
+	uint8_t* mLastScaled;     //copy of last scaled front, so it can be reused
+	uint32_t mLastScaledSize;
+	bool mHasScaled;
+};
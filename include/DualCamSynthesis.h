@@ -18,6 +18,19 @@
 #define GET_ALIGNED(num, stride) (((num) + (stride) - 1) & (~((stride) - 1)))
 size_t getAlignedStride(int32_t num, int32_t stride);
 
+#define DCS_STRIP_RING_ROWS 4
+
+// adaptive quality: degrade when average frame cost > 90% of budget,
+// climb when it stays < 60% of budget for 30 frames
+#define DCS_TIER_DEGRADE_RATIO 90
+#define DCS_TIER_CLIMB_RATIO 60
+#define DCS_TIER_CLIMB_FRAMES 30
+#define DCS_TIER_HOLD_FRAMES 4
+
+// auto tune: candidate output may differ from libyuv by at most 2 per sample
+#define DCS_TUNE_MAX_ROUNDS 64
+#define DCS_TUNE_MAX_DIFF 2
+
 enum DUAL_CAM_SYNTHESIS_IMG_FORMAT {
 	DCS_YUV420NV12 = 0,
 	DCS_YUV420NV21,
@@ -38,6 +51,26 @@ enum DUAL_CAM_SYNTHESIS_MIRRORFLIP_STATE {
 	NEED_BOTH,
 };
 
+enum DUAL_CAM_SYNTHESIS_SCALER {
+	DCS_SCALER_LIBYUV = 0,
+	DCS_SCALER_STRIP,
+	DCS_SCALER_NUM,
+};
+
+enum DUAL_CAM_SYNTHESIS_QUALITY_TIER {
+	DCS_TIER_BILINEAR = 0,
+	DCS_TIER_LINEAR,          //horizontal only filtering, skipped by the strip scaler
+	DCS_TIER_NEAREST,         //skipped by the strip scaler
+	DCS_TIER_REUSE_SCALED,    //scale front every other frame, reuse it in between
+	DCS_TIER_NO_MIRROR,       //also skip mirror/flip
+};
+
+enum DUAL_CAM_SYNTHESIS_DISPLAY_FORMAT {
+	DCS_DISPLAY_RGBA = 0,
+	DCS_DISPLAY_BGRA,
+	DCS_DISPLAY_NOT_SUPPORT,
+};
+
 enum DUAL_CAM_SYNTHESIS_RESULT {
 	NO_ERROR = 0,
 	NOT_INITED,
@@ -63,6 +96,10 @@ struct BEGIN_POINT {
 	bool onOddCol;
 };
 
+// paste of a fixed camera mode, see DualCamFixedMode.h
+typedef void (*DCS_FIXED_PASTE_FUNC)(uint8_t* frontY, uint8_t* frontUV,
+	uint8_t* backY, uint8_t* backUV, uint32_t x, uint32_t y);
+
 struct DUAL_CAM_SYNTHESIS_PARAM {
 	IMG_INFO inputFrontInfo;
 	IMG_INFO frontScaledInfo;
@@ -84,13 +121,38 @@ public:
 	int32_t ProcessSynthesis(void* frontData, void* backData);
 	int32_t ProcessSynthesis(void* frontDataY, void* frontDataUV, 
 							 void* backDataY, void* backDataUV);
+	// also writes the composited frame to displayData as 32bit RGBA/BGRA.
+	// set backUpdated to false when backData is the same back frame as last call,
+	// then only the old and new PiP rect of displayData will be rewritten.
+	// backUpdated can not be false before a full frame has been written.
+	int32_t ProcessSynthesisDisplay(void* frontData, void* backData,
+									void* displayData, bool backUpdated);
+	int32_t ProcessSynthesisDisplay(void* frontDataY, void* frontDataUV,
+									void* backDataY, void* backDataUV,
+									void* displayData, bool backUpdated);
 	int32_t SetParams(DUAL_CAM_SYNTHESIS_PARAM param);
+	int32_t GetParams(DUAL_CAM_SYNTHESIS_PARAM* param);
 	int32_t SetInitParams(uint32_t forntW, uint32_t frontH, 
 					uint32_t scaledW, uint32_t scaledH,
 					uint32_t backW, uint32_t backH,
 					uint32_t stride, uint32_t scanline,
 					uint32_t targetX, uint32_t targetY,
 					uint32_t format);
+	int32_t SetDisplayParams(uint32_t format, uint32_t stride);
+	// scale front row by row through a small ring instead of a full-frame mScaleBuf,
+	// must be set before Initialize()
+	int32_t SetStripMode(bool enable);
+	// time every scaler on a synthetic front in Initialize() for about budgetMs,
+	// and keep the fastest one. result is cached in cachePath if it's not null
+	int32_t SetAutoTune(bool enable, uint32_t budgetMs, const char* cachePath);
+	int32_t GetScaler();
+	// per frame budget of ProcessDownScale + ProcessSynthesis in us, 0 disables
+	// adaptive quality. must be set after Initialize()
+	int32_t SetTimeBudget(uint32_t budgetUs);
+	int32_t GetQualityTier();
+	int32_t SetMirrorFlipState(int32_t state);
+	// use a registered fixed mode paste when params match one, enabled by default
+	int32_t SetFixedModeEnable(bool enable);
 	int32_t UpdateTargetPoint(BEGIN_POINT point);
 	int32_t CheckParams();
 	int32_t FixTargetPoint();
@@ -104,4 +166,57 @@ private:
 	uint8_t* mScaleBuf;
 	int32_t mOverRangeState;
 	int32_t mMirrorFlipState;
+
+	int32_t ScaleFront(void* src);
+	int32_t ScaleFront(void* dataY, void* dataUV);
+	int32_t PasteFront(void* frontData, void* backData);
+	int32_t PasteFront(void* frontDataY, void* frontDataUV,
+		void* backDataY, void* backDataUV);
+	bool ReuseLastScaled();
+	void UpdateQualityTier();
+	void SetQualityTier(int32_t tier);
+
+	int32_t mScaleFilter;
+	uint32_t mTimeBudget;
+	int32_t mQualityTier;
+	uint64_t mFrameCost;      //ProcessDownScale + ProcessSynthesis of current frame
+	uint64_t mAvgCost;
+	uint32_t mHeadroomFrames;
+	uint32_t mTierHoldFrames;
+	uint32_t mFrameCount;
+	uint8_t* mLastScaled;
+	bool mHasLastScaled;
+
+	int32_t AutoTune();
+	void GetTuneKey(char* key, size_t size);
+	int32_t LoadTuneCache();
+	int32_t SaveTuneCache();
+
+	bool mAutoTune;
+	uint32_t mTuneBudgetMs;
+	char mTuneCachePath[256];
+
+	int32_t ProcessStripDownScale(uint8_t* srcY, uint8_t* srcUV,
+		uint8_t* dstY, uint8_t* dstUV);
+	void StripScalePlane(uint8_t* src, int32_t srcStride, int32_t srcW, int32_t srcH,
+		uint8_t* dst, int32_t dstStride, int32_t dstW, int32_t dstH, int32_t bpp);
+
+	bool mStripMode;
+	uint8_t* mStripRing;    //DCS_STRIP_RING_ROWS horizontally scaled rows
+	int32_t* mStripXTab;    //16.16 source x of every scaled column
+
+	int32_t ConvertToDisplay(uint8_t* srcY, int32_t srcStride, uint8_t* srcUV,
+		uint32_t srcFormat, uint8_t* dst, int32_t dstStride, int32_t width, int32_t height);
+
+	void UpdateFixedMode();
+
+	bool mFixedModeEnable;
+	DCS_FIXED_PASTE_FUNC mFixedPaste[NEED_BOTH + 1];    //indexed by mirror flip state
+
+	bool mDisplayEnabled;
+	bool mDisplaySaved;
+	IMG_INFO mDisplayInfo;
+	BEGIN_POINT mDisplaySavedPoint;
+	uint8_t* mDisplaySaveBuf;    //background under last PiP rect
+	uint8_t* mDisplayPipBuf;     //PiP in RGBA before mirror/flip
 };
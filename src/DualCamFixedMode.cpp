@@ -0,0 +1,89 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// Author: Peng Hao
+// License: GPL
+//////////////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////////////
+// @file: DualCamFixedMode.cpp
+// @brief: Registry of fixed camera modes. SynthesisEngine looks its params up here
+//      and uses the specialized paste instead of the generic one when they match.
+//////////////////////////////////////////////////////////////////////////////////////
+
+#include "DualCamFixedMode.h"
+
+#define DCS_FIXED_MODE_ALL_MIRROR(BW, BH, PW, PH, FMT) \
+	FixedModeEngine<BW, BH, PW, PH, FMT, NEEDNOT>::GetMode(), \
+	FixedModeEngine<BW, BH, PW, PH, FMT, NEED_X_MIRROR>::GetMode(), \
+	FixedModeEngine<BW, BH, PW, PH, FMT, NEED_Y_FLIP>::GetMode(), \
+	FixedModeEngine<BW, BH, PW, PH, FMT, NEED_BOTH>::GetMode()
+
+// the modes products ship with, PiP is 1/5 of back image
+static const DCS_FIXED_MODE gBuiltinMode[] = {
+	DCS_FIXED_MODE_ALL_MIRROR(1280, 720, 256, 144, DCS_YUV420NV12),
+	DCS_FIXED_MODE_ALL_MIRROR(1920, 1080, 384, 216, DCS_YUV420NV12),
+	DCS_FIXED_MODE_ALL_MIRROR(3840, 2160, 768, 432, DCS_YUV420NV12),
+	DCS_FIXED_MODE_ALL_MIRROR(1280, 720, 256, 144, DCS_YUV420NV21),
+	DCS_FIXED_MODE_ALL_MIRROR(1920, 1080, 384, 216, DCS_YUV420NV21),
+	DCS_FIXED_MODE_ALL_MIRROR(3840, 2160, 768, 432, DCS_YUV420NV21),
+};
+static_assert(sizeof(gBuiltinMode) / sizeof(gBuiltinMode[0]) <= DCS_MAX_FIXED_MODE,
+	"too many built-in fixed modes");
+
+static DCS_FIXED_MODE gFixedMode[DCS_MAX_FIXED_MODE];
+static uint32_t gFixedModeNum = 0;
+
+// built-ins are copied in on first use, the local static makes that happen once
+static void LoadBuiltinMode()
+{
+	static bool loaded = []() {
+		gFixedModeNum = sizeof(gBuiltinMode) / sizeof(gBuiltinMode[0]);
+		memcpy(gFixedMode, gBuiltinMode, sizeof(gBuiltinMode));
+		return true;
+	}();
+	(void)loaded;
+}
+
+
+int32_t RegisterFixedMode(DCS_FIXED_MODE mode)
+{
+	if (mode.paste == nullptr) {
+		return EMPTY_INPUT;
+	}
+
+	LoadBuiltinMode();
+
+	// a mode registered again replaces the old paste
+	for (uint32_t i = 0; i < gFixedModeNum; i++) {
+		if (gFixedMode[i].backW == mode.backW && gFixedMode[i].backH == mode.backH &&
+			gFixedMode[i].pipW == mode.pipW && gFixedMode[i].pipH == mode.pipH &&
+			gFixedMode[i].format == mode.format &&
+			gFixedMode[i].mirrorFlipState == mode.mirrorFlipState) {
+			gFixedMode[i].paste = mode.paste;
+			return NO_ERROR;
+		}
+	}
+
+	if (gFixedModeNum >= DCS_MAX_FIXED_MODE) {
+		return NO_MEMORY;
+	}
+
+	gFixedMode[gFixedModeNum++] = mode;
+	return NO_ERROR;
+}
+
+DCS_FIXED_PASTE_FUNC FindFixedMode(uint32_t backW, uint32_t backH,
+	uint32_t pipW, uint32_t pipH, uint32_t format, int32_t mirrorFlipState)
+{
+	LoadBuiltinMode();
+
+	for (uint32_t i = 0; i < gFixedModeNum; i++) {
+		if (gFixedMode[i].backW == backW && gFixedMode[i].backH == backH &&
+			gFixedMode[i].pipW == pipW && gFixedMode[i].pipH == pipH &&
+			gFixedMode[i].format == format &&
+			gFixedMode[i].mirrorFlipState == mirrorFlipState) {
+			return gFixedMode[i].paste;
+		}
+	}
+
+	return nullptr;
+}
@@ -0,0 +1,401 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// Author: Peng Hao
+// License: GPL
+//////////////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////////////
+// @file: DualCamFrameServer.cpp
+// @brief: Run SynthesisEngine as a local server. Front/back/output frames live in
+//      memfd backed rings, capture writes them in place, the engine scales and
+//      composites in place, and the encoder reads the composited back slot.
+//      Nothing is copied between processes. Linux only.
+//////////////////////////////////////////////////////////////////////////////////////
+
+#include "DualCamFrameServer.h"
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define DCS_SLOT_ALIGN 4096
+
+
+FrameServer::FrameServer()
+	:mInited(false)
+	,mIsServer(false)
+	,mHeader(nullptr)
+	,mBase(nullptr)
+	,mMapSize(0)
+	,mEngine(nullptr)
+	,mFrontScaled(false)
+{
+	mFds.memFd = -1;
+	mFds.backEvent = -1;
+	mFds.outputEvent = -1;
+}
+
+FrameServer::~FrameServer()
+{
+	Destroy();
+}
+
+int32_t FrameServer::Create(SynthesisEngine* engine, uint32_t slotNum)
+{
+	int32_t result = NO_ERROR;
+	DUAL_CAM_SYNTHESIS_PARAM param;
+	uint64_t frontSlot = 0, backSlot = 0, headerSize = 0, size = 0;
+
+	if (engine == nullptr) {
+		result = EMPTY_INPUT;
+	}
+	else if (mInited || !engine->mInited) {
+		result = ORDER_ERROR;
+	}
+	else if (slotNum < 2 || slotNum > DCS_SERVER_MAX_SLOT) {
+		result = INVALID_PARAM;
+	}
+
+	if (SUCCESS(result)) {
+		result = engine->GetParams(&param);
+	}
+
+	if (SUCCESS(result)) {
+		headerSize = GET_ALIGNED(sizeof(DCS_SHM_HEADER), DCS_SLOT_ALIGN);
+		frontSlot = GET_ALIGNED((uint64_t)param.inputFrontInfo.bufSize, DCS_SLOT_ALIGN);
+		backSlot = GET_ALIGNED((uint64_t)param.inputBackInfo.bufSize, DCS_SLOT_ALIGN);
+		size = headerSize + (frontSlot + backSlot) * slotNum;
+
+		// from here on Destroy() owns and closes whatever has been opened
+		mIsServer = true;
+		mFds.memFd = memfd_create("DualCamFrameServer", MFD_CLOEXEC);
+		mFds.backEvent = eventfd(0, EFD_NONBLOCK);
+		mFds.outputEvent = eventfd(0, EFD_NONBLOCK);
+		if (mFds.memFd < 0 || mFds.backEvent < 0 || mFds.outputEvent < 0) {
+			result = NO_MEMORY;
+		}
+	}
+
+	if (SUCCESS(result) && ftruncate(mFds.memFd, size) != 0) {
+		result = NO_MEMORY;
+	}
+
+	if (SUCCESS(result)) {
+		result = Map(mFds.memFd);
+	}
+
+	if (SUCCESS(result)) {
+		// memfd is zero filled, atomics start at 0
+		mHeader->size = size;
+		mHeader->param = param;
+		mHeader->front.slotNum = slotNum;
+		mHeader->front.slotSize = frontSlot;
+		mHeader->front.offset = headerSize;
+		mHeader->back.slotNum = slotNum;
+		mHeader->back.slotSize = backSlot;
+		mHeader->back.offset = headerSize + frontSlot * slotNum;
+		mHeader->magic = DCS_SERVER_MAGIC;
+		mEngine = engine;
+		mFrontScaled = false;
+		mInited = true;
+	}
+	else if (mIsServer && !mInited) {
+		Destroy();
+	}
+
+	return result;
+}
+
+int32_t FrameServer::Attach(DCS_SERVER_FDS fds)
+{
+	int32_t result = NO_ERROR;
+
+	if (mInited) {
+		result = ORDER_ERROR;
+	}
+
+	if (SUCCESS(result)) {
+		mFds = fds;
+		result = Map(fds.memFd);
+	}
+
+	// the header comes from another process, check it before any slot is used
+	if (SUCCESS(result) &&
+		(mHeader->magic != DCS_SERVER_MAGIC || mHeader->size > mMapSize ||
+		!CheckRing(&mHeader->front) || !CheckRing(&mHeader->back))) {
+		result = INVALID_PARAM;
+	}
+
+	if (SUCCESS(result)) {
+		mIsServer = false;
+		mInited = true;
+	}
+	else {
+		if (mBase != nullptr) {
+			munmap(mBase, mMapSize);
+		}
+		mBase = nullptr;
+		mHeader = nullptr;
+		mMapSize = 0;
+	}
+
+	return result;
+}
+
+int32_t FrameServer::Map(int32_t memFd)
+{
+	struct stat st;
+
+	if (fstat(memFd, &st) != 0 || st.st_size < (off_t)sizeof(DCS_SHM_HEADER)) {
+		return INVALID_PARAM;
+	}
+
+	void* addr = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+	if (addr == MAP_FAILED) {
+		return NO_MEMORY;
+	}
+
+	mBase = static_cast<uint8_t*>(addr);
+	mHeader = reinterpret_cast<DCS_SHM_HEADER*>(mBase);
+	mMapSize = st.st_size;
+	return NO_ERROR;
+}
+
+bool FrameServer::CheckRing(DCS_SHM_RING* ring)
+{
+	if (ring->slotNum < 2 || ring->slotNum > DCS_SERVER_MAX_SLOT) {
+		return false;
+	}
+
+	return ring->offset <= mMapSize &&
+		(uint64_t)ring->slotNum * ring->slotSize <= mMapSize - ring->offset;
+}
+
+int32_t FrameServer::GetFds(DCS_SERVER_FDS* fds)
+{
+	if (fds == nullptr) {
+		return EMPTY_INPUT;
+	}
+	else if (!mInited) {
+		return NOT_INITED;
+	}
+
+	*fds = mFds;
+	return NO_ERROR;
+}
+
+int32_t FrameServer::GetParams(DUAL_CAM_SYNTHESIS_PARAM* param)
+{
+	if (param == nullptr) {
+		return EMPTY_INPUT;
+	}
+	else if (!mInited) {
+		return NOT_INITED;
+	}
+
+	*param = mHeader->param;
+	return NO_ERROR;
+}
+
+int32_t FrameServer::Destroy()
+{
+	if (mBase != nullptr) {
+		munmap(mBase, mMapSize);
+	}
+	mBase = nullptr;
+	mHeader = nullptr;
+	mMapSize = 0;
+
+	// fds of an attached client belong to whoever passed them in
+	if (mIsServer) {
+		int32_t fd[] = { mFds.memFd, mFds.backEvent, mFds.outputEvent };
+		for (size_t i = 0; i < sizeof(fd) / sizeof(fd[0]); i++) {
+			if (fd[i] >= 0) {
+				close(fd[i]);
+			}
+		}
+	}
+	mFds.memFd = -1;
+	mFds.backEvent = -1;
+	mFds.outputEvent = -1;
+	mEngine = nullptr;
+	mIsServer = false;
+	mInited = false;
+
+	return NO_ERROR;
+}
+
+uint8_t* FrameServer::GetSlot(DCS_SHM_RING* ring, uint32_t index)
+{
+	return mBase + ring->offset + (uint64_t)(index % ring->slotNum) * ring->slotSize;
+}
+
+int32_t FrameServer::WaitEvent(int32_t eventFd, int32_t timeoutMs)
+{
+	struct pollfd pfd;
+	uint64_t count;
+
+	pfd.fd = eventFd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	if (poll(&pfd, 1, timeoutMs) <= 0) {
+		return EMPTY_INPUT;
+	}
+
+	// drain the counter, the ring indices tell how much work there is
+	if (read(eventFd, &count, sizeof(count)) != sizeof(count)) {
+		return EMPTY_INPUT;
+	}
+	return NO_ERROR;
+}
+
+void FrameServer::SignalEvent(int32_t eventFd)
+{
+	uint64_t one = 1;
+	ssize_t ret = write(eventFd, &one, sizeof(one));
+	(void)ret;
+}
+
+uint8_t* FrameServer::AcquireFrontSlot()
+{
+	if (!mInited) {
+		return nullptr;
+	}
+
+	DCS_SHM_RING* ring = &mHeader->front;
+	uint32_t head = ring->head.load(std::memory_order_relaxed);
+	if (head - ring->tail.load(std::memory_order_acquire) >= ring->slotNum) {
+		return nullptr;
+	}
+	return GetSlot(ring, head);
+}
+
+int32_t FrameServer::SubmitFront(uint64_t timestamp)
+{
+	if (!mInited) {
+		return NOT_INITED;
+	}
+
+	DCS_SHM_RING* ring = &mHeader->front;
+	uint32_t head = ring->head.load(std::memory_order_relaxed);
+	ring->timestamp[head % ring->slotNum] = timestamp;
+	ring->head.store(head + 1, std::memory_order_release);
+
+	return NO_ERROR;
+}
+
+uint8_t* FrameServer::AcquireBackSlot()
+{
+	if (!mInited) {
+		return nullptr;
+	}
+
+	DCS_SHM_RING* ring = &mHeader->back;
+	uint32_t head = ring->head.load(std::memory_order_relaxed);
+	if (head - ring->tail.load(std::memory_order_acquire) >= ring->slotNum) {
+		return nullptr;
+	}
+	return GetSlot(ring, head);
+}
+
+int32_t FrameServer::SubmitBack(uint64_t timestamp)
+{
+	if (!mInited) {
+		return NOT_INITED;
+	}
+
+	DCS_SHM_RING* ring = &mHeader->back;
+	uint32_t head = ring->head.load(std::memory_order_relaxed);
+	ring->timestamp[head % ring->slotNum] = timestamp;
+	ring->head.store(head + 1, std::memory_order_release);
+	SignalEvent(mFds.backEvent);
+
+	return NO_ERROR;
+}
+
+int32_t FrameServer::ProcessOnce(int32_t timeoutMs)
+{
+	int32_t result = NO_ERROR;
+	DCS_SHM_RING* front = nullptr;
+	DCS_SHM_RING* back = nullptr;
+
+	if (!mInited || !mIsServer) {
+		result = ORDER_ERROR;
+	}
+	else {
+		front = &mHeader->front;
+		back = &mHeader->back;
+	}
+
+	if (SUCCESS(result) &&
+		back->composed.load(std::memory_order_relaxed) == back->head.load(std::memory_order_acquire)) {
+		result = WaitEvent(mFds.backEvent, timeoutMs);
+	}
+
+	while (SUCCESS(result)) {
+		uint32_t composed = back->composed.load(std::memory_order_relaxed);
+		if (composed == back->head.load(std::memory_order_acquire)) {
+			break;
+		}
+
+		// only the newest front is used. the scaled one stays in its slot until
+		// a newer front comes, so it can be reused without any copy
+		uint32_t frontHead = front->head.load(std::memory_order_acquire);
+		uint32_t frontTail = front->tail.load(std::memory_order_relaxed);
+		if (frontHead - frontTail > 1 || (frontHead != frontTail && !mFrontScaled)) {
+			front->tail.store(frontHead - 1, std::memory_order_release);
+			result = mEngine->ProcessDownScale(GetSlot(front, frontHead - 1));
+			mFrontScaled = SUCCESS(result);
+		}
+
+		if (SUCCESS(result) && mFrontScaled) {
+			result = mEngine->ProcessSynthesis(
+				GetSlot(front, front->tail.load(std::memory_order_relaxed)),
+				GetSlot(back, composed));
+		}
+
+		// back frame goes out even without a front, the encoder must not stall
+		back->composed.store(composed + 1, std::memory_order_release);
+		SignalEvent(mFds.outputEvent);
+	}
+
+	return result;
+}
+
+uint8_t* FrameServer::AcquireOutput(int32_t timeoutMs, uint64_t* timestamp)
+{
+	if (!mInited) {
+		return nullptr;
+	}
+
+	DCS_SHM_RING* ring = &mHeader->back;
+	uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+	if (tail == ring->composed.load(std::memory_order_acquire)) {
+		WaitEvent(mFds.outputEvent, timeoutMs);
+		if (tail == ring->composed.load(std::memory_order_acquire)) {
+			return nullptr;
+		}
+	}
+
+	if (timestamp != nullptr) {
+		*timestamp = ring->timestamp[tail % ring->slotNum];
+	}
+	return GetSlot(ring, tail);
+}
+
+int32_t FrameServer::ReleaseOutput()
+{
+	if (!mInited) {
+		return NOT_INITED;
+	}
+
+	DCS_SHM_RING* ring = &mHeader->back;
+	uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+	if (tail == ring->composed.load(std::memory_order_acquire)) {
+		return ORDER_ERROR;
+	}
+	ring->tail.store(tail + 1, std::memory_order_release);
+
+	return NO_ERROR;
+}
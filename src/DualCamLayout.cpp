@@ -0,0 +1,358 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// Author: Peng Hao
+// License: GPL
+//////////////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////////////
+// @file: DualCamLayout.cpp
+// @brief: Split screen layouts, side by side, top/bottom and 2x2. Every camera
+//      image is downscaled directly into its own cell of the output image.
+// @param: the input Img format should be YUV420, and 8bit for per pixel
+//////////////////////////////////////////////////////////////////////////////////////
+
+#include "DualCamLayout.h"
+#include "libyuv.h"
+
+#include <system_error>
+
+
+LayoutEngine::LayoutEngine()
+	:mInited(false)
+	,mParamValid(false)
+	,mParallel(true)
+	,mCellNum(0)
+	,mWorkerNum(0)
+	,mStop(false)
+	,mGeneration(0)
+	,mPending(0)
+	,mFrameDst(nullptr)
+{
+}
+
+LayoutEngine::~LayoutEngine()
+{
+	Deinit();
+}
+
+int32_t LayoutEngine::SetParams(DUAL_CAM_LAYOUT_PARAM param)
+{
+	int32_t result = NO_ERROR;
+
+	if (mInited) {
+		return ORDER_ERROR;
+	}
+
+	memcpy(&mParam, &param, sizeof(DUAL_CAM_LAYOUT_PARAM));
+	mParamValid = true;
+
+	return result;
+}
+
+int32_t LayoutEngine::SetParallel(bool enable)
+{
+	// workers are started by Initialize()
+	if (mInited) {
+		return ORDER_ERROR;
+	}
+
+	mParallel = enable;
+	return NO_ERROR;
+}
+
+int32_t LayoutEngine::Initialize()
+{
+	int32_t result = NO_ERROR;
+
+	if (!mParamValid || mInited) {
+		result = ORDER_ERROR;
+	}
+
+	if (SUCCESS(result)) {
+		result = CheckParams();
+	}
+
+	if (SUCCESS(result)) {
+		mCellNum = (mParam.mode == DCS_LAYOUT_GRID_2X2) ? 4 : 2;
+		for (uint32_t i = 0; i < mCellNum; i++) {
+			ComputeRegion(i);
+		}
+	}
+
+	// one persistent worker per source but the first, which the caller scales
+	if (SUCCESS(result) && mParallel) {
+		mStop = false;
+		mGeneration = 0;
+		mPending = 0;
+		for (uint32_t i = 1; i < mParam.sourceNum && SUCCESS(result); i++) {
+			try {
+				mWorker[i] = std::thread(&LayoutEngine::WorkerLoop, this, i);
+				mWorkerNum++;
+			}
+			catch (const std::system_error&) {
+				result = NO_MEMORY;
+			}
+		}
+		if (!SUCCESS(result)) {
+			StopWorkers();
+		}
+	}
+
+	if (SUCCESS(result)) {
+		mInited = true;
+	}
+
+	return result;
+}
+
+int32_t LayoutEngine::Deinit()
+{
+	StopWorkers();
+	mInited = false;
+	mParamValid = false;
+
+	return NO_ERROR;
+}
+
+int32_t LayoutEngine::CheckParams()
+{
+	uint32_t maxSource = (mParam.mode == DCS_LAYOUT_GRID_2X2) ? 4 : 2;
+
+	if (mParam.mode >= DCS_LAYOUT_NOT_SUPPORT || mParam.fit >= DCS_FIT_NOT_SUPPORT) {
+		return INVALID_PARAM;
+	}
+
+	if (mParam.sourceNum == 0 || mParam.sourceNum > maxSource) {
+		return INVALID_PARAM;
+	}
+
+	// NV12 and NV21 only differ in UV order, which a scale can not swap
+	if (mParam.outputInfo.format >= DCS_NOT_SUPPORT ||
+		mParam.outputInfo.width < 4 || mParam.outputInfo.height < 4) {
+		return INVALID_PARAM;
+	}
+
+	// cells are even sized, an odd last row/column would never be written
+	if (mParam.outputInfo.width % 2 == 1 || mParam.outputInfo.height % 2 == 1) {
+		return INVALID_PARAM;
+	}
+
+	for (uint32_t i = 0; i < mParam.sourceNum; i++) {
+		if (mParam.sourceInfo[i].format != mParam.outputInfo.format ||
+			mParam.sourceInfo[i].width < 2 || mParam.sourceInfo[i].height < 2) {
+			return INVALID_PARAM;
+		}
+	}
+
+	return NO_ERROR;
+}
+
+void LayoutEngine::ComputeRegion(uint32_t cell)
+{
+	DCS_LAYOUT_REGION* region = &mRegion[cell];
+	uint32_t halfW = (mParam.outputInfo.width / 2) & ~1;
+	uint32_t halfH = (mParam.outputInfo.height / 2) & ~1;
+	bool right = (mParam.mode == DCS_LAYOUT_TOP_BOTTOM) ? false : (cell % 2 == 1);
+	bool bottom = (mParam.mode == DCS_LAYOUT_SIDE_BY_SIDE) ? false :
+		(mParam.mode == DCS_LAYOUT_TOP_BOTTOM) ? (cell == 1) : (cell >= 2);
+	bool fullW = (mParam.mode == DCS_LAYOUT_TOP_BOTTOM);
+	bool fullH = (mParam.mode == DCS_LAYOUT_SIDE_BY_SIDE);
+
+	// cells keep even x/y/width/height, so they start on a UV sample
+	region->x = right ? halfW : 0;
+	region->y = bottom ? halfH : 0;
+	region->width = fullW ? (mParam.outputInfo.width & ~1) :
+		right ? ((mParam.outputInfo.width - halfW) & ~1) : halfW;
+	region->height = fullH ? (mParam.outputInfo.height & ~1) :
+		bottom ? ((mParam.outputInfo.height - halfH) & ~1) : halfH;
+
+	if (cell >= mParam.sourceNum) {
+		return;
+	}
+
+	uint64_t sw = mParam.sourceInfo[cell].width & ~1;
+	uint64_t sh = mParam.sourceInfo[cell].height & ~1;
+	uint64_t rw = region->width;
+	uint64_t rh = region->height;
+
+	region->outX = 0;
+	region->outY = 0;
+	region->outW = rw;
+	region->outH = rh;
+	region->cropX = 0;
+	region->cropY = 0;
+	region->cropW = sw;
+	region->cropH = sh;
+
+	if (mParam.fit == DCS_FIT_LETTERBOX) {
+		if (sw * rh > sh * rw) {
+			region->outH = (uint32_t)(sh * rw / sw) & ~1;
+			region->outY = ((rh - region->outH) / 2) & ~1;
+		}
+		else {
+			region->outW = (uint32_t)(sw * rh / sh) & ~1;
+			region->outX = ((rw - region->outW) / 2) & ~1;
+		}
+	}
+	else if (mParam.fit == DCS_FIT_CROP) {
+		if (sw * rh > sh * rw) {
+			region->cropW = (uint32_t)(sh * rw / rh) & ~1;
+			region->cropX = ((sw - region->cropW) / 2) & ~1;
+		}
+		else {
+			region->cropH = (uint32_t)(sw * rh / rw) & ~1;
+			region->cropY = ((sh - region->cropH) / 2) & ~1;
+		}
+	}
+}
+
+int32_t LayoutEngine::ProcessLayout(void** sourceData, void* outputData)
+{
+	int32_t result = NO_ERROR;
+	uint8_t* dst = static_cast<uint8_t*>(outputData);
+
+	if (sourceData == nullptr || outputData == nullptr) {
+		result = EMPTY_INPUT;
+	}
+	else if (!mInited) {
+		result = NOT_INITED;
+	}
+
+	for (uint32_t i = 0; i < mParam.sourceNum && SUCCESS(result); i++) {
+		if (sourceData[i] == nullptr) {
+			result = EMPTY_INPUT;
+		}
+	}
+
+	// cells do not overlap, so every scale can write the output at the same time
+	if (SUCCESS(result) && mWorkerNum > 0) {
+		std::lock_guard<std::mutex> guard(mLock);
+		for (uint32_t i = 1; i < mParam.sourceNum; i++) {
+			mFrameSrc[i] = static_cast<uint8_t*>(sourceData[i]);
+		}
+		mFrameDst = dst;
+		mPending = mWorkerNum;
+		mGeneration++;
+		mStartCond.notify_all();
+	}
+
+	if (SUCCESS(result)) {
+		for (uint32_t i = mParam.sourceNum; i < mCellNum; i++) {
+			FillBlack(dst, mRegion[i].x, mRegion[i].y, mRegion[i].width, mRegion[i].height);
+		}
+		mCellResult[0] = ProcessRegion(0, static_cast<uint8_t*>(sourceData[0]), dst);
+		for (uint32_t i = 1; i < mParam.sourceNum && mWorkerNum == 0; i++) {
+			mCellResult[i] = ProcessRegion(i, static_cast<uint8_t*>(sourceData[i]), dst);
+		}
+	}
+
+	if (SUCCESS(result) && mWorkerNum > 0) {
+		std::unique_lock<std::mutex> lock(mLock);
+		mDoneCond.wait(lock, [this]() { return mPending == 0; });
+	}
+
+	for (uint32_t i = 0; i < mParam.sourceNum && SUCCESS(result); i++) {
+		result = mCellResult[i];
+	}
+
+	return result;
+}
+
+void LayoutEngine::WorkerLoop(uint32_t index)
+{
+	uint32_t generation = 0;
+
+	while (true) {
+		std::unique_lock<std::mutex> lock(mLock);
+		mStartCond.wait(lock, [this, generation]() {
+			return mStop || mGeneration != generation;
+		});
+		if (mStop) {
+			return;
+		}
+		generation = mGeneration;
+		uint8_t* src = mFrameSrc[index];
+		uint8_t* dst = mFrameDst;
+		lock.unlock();
+
+		int32_t result = ProcessRegion(index, src, dst);
+
+		lock.lock();
+		mCellResult[index] = result;
+		if (--mPending == 0) {
+			mDoneCond.notify_one();
+		}
+	}
+}
+
+void LayoutEngine::StopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> guard(mLock);
+		mStop = true;
+		mStartCond.notify_all();
+	}
+	for (uint32_t i = 1; i < DCS_LAYOUT_MAX_SOURCE; i++) {
+		if (mWorker[i].joinable()) {
+			mWorker[i].join();
+		}
+	}
+	mWorkerNum = 0;
+}
+
+int32_t LayoutEngine::ProcessRegion(uint32_t index, uint8_t* src, uint8_t* dst)
+{
+	int32_t result = NO_ERROR;
+	DCS_LAYOUT_REGION* region = &mRegion[index];
+	IMG_INFO* srcInfo = &mParam.sourceInfo[index];
+
+	int32_t alignedSrcW = getAlignedStride(srcInfo->width, srcInfo->stride);
+	int32_t alignedSrcH = getAlignedStride(srcInfo->height, srcInfo->scanline);
+	int32_t alignedDstW = getAlignedStride(mParam.outputInfo.width, mParam.outputInfo.stride);
+	int32_t alignedDstH = getAlignedStride(mParam.outputInfo.height, mParam.outputInfo.scanline);
+
+	uint8_t* srcY = src + region->cropY * alignedSrcW + region->cropX;
+	uint8_t* srcUV = src + alignedSrcW * alignedSrcH +
+		region->cropY / 2 * alignedSrcW + region->cropX;
+	uint32_t x = region->x + region->outX;
+	uint32_t y = region->y + region->outY;
+	uint8_t* dstY = dst + y * alignedDstW + x;
+	uint8_t* dstUV = dst + alignedDstW * alignedDstH + y / 2 * alignedDstW + x;
+
+	result = libyuv::NV12Scale(srcY, alignedSrcW, srcUV, alignedSrcW,
+		region->cropW, region->cropH,
+		dstY, alignedDstW, dstUV, alignedDstW,
+		region->outW, region->outH,
+		libyuv::kFilterBilinear);
+	result = (result == 0) ? NO_ERROR : INVALID_PARAM;
+
+	// letterbox borders, only the part of the cell the image does not cover
+	if (SUCCESS(result)) {
+		uint32_t right = region->outX + region->outW;
+		uint32_t bottom = region->outY + region->outH;
+		FillBlack(dst, region->x, region->y, region->width, region->outY);
+		FillBlack(dst, region->x, region->y + bottom, region->width, region->height - bottom);
+		FillBlack(dst, region->x, y, region->outX, region->outH);
+		FillBlack(dst, region->x + right, y, region->width - right, region->outH);
+	}
+
+	return result;
+}
+
+void LayoutEngine::FillBlack(uint8_t* dst, uint32_t x, uint32_t y,
+	uint32_t width, uint32_t height)
+{
+	int32_t alignedDstW = getAlignedStride(mParam.outputInfo.width, mParam.outputInfo.stride);
+	int32_t alignedDstH = getAlignedStride(mParam.outputInfo.height, mParam.outputInfo.scanline);
+	uint8_t* dstUV = dst + alignedDstW * alignedDstH;
+
+	if (width == 0 || height == 0) {
+		return;
+	}
+
+	for (uint32_t row = 0; row < height; row++) {
+		memset(dst + (y + row) * alignedDstW + x, 16, width);
+	}
+	for (uint32_t row = 0; row < height / 2; row++) {
+		memset(dstUV + (y / 2 + row) * alignedDstW + x, 128, width);
+	}
+}
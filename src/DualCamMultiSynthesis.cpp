@@ -0,0 +1,270 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// Author: Peng Hao
+// License: GPL
+//////////////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////////////
+// @file: DualCamMultiSynthesis.cpp
+// @brief: Synthesis one front image into several back images of different sizes,
+//      e.g. a preview and a record stream, with one shared downscale pyramid.
+// @param: the input Img format should be YUV420, and 8bit for per pixel
+//////////////////////////////////////////////////////////////////////////////////////
+
+#include "DualCamMultiSynthesis.h"
+#include "libyuv.h"
+
+
+MultiSynthesisEngine::MultiSynthesisEngine()
+	:mInited(false)
+	,mFrontValid(false)
+	,mOutputNum(0)
+	,mLevelNum(0)
+	,mPyramidBuf(nullptr)
+	,mPipBuf(nullptr)
+{
+}
+
+MultiSynthesisEngine::~MultiSynthesisEngine()
+{
+	Deinit();
+}
+
+int32_t MultiSynthesisEngine::SetFrontParams(IMG_INFO frontInfo)
+{
+	int32_t result = NO_ERROR;
+
+	if (mInited) {
+		result = ORDER_ERROR;
+	}
+	else if (frontInfo.format >= DCS_NOT_SUPPORT) {
+		result = INVALID_PARAM;
+	}
+
+	if (SUCCESS(result)) {
+		memcpy(&mFrontInfo, &frontInfo, sizeof(IMG_INFO));
+		mFrontValid = true;
+	}
+
+	return result;
+}
+
+int32_t MultiSynthesisEngine::AddOutput(IMG_INFO frontScaledInfo, IMG_INFO backInfo,
+	BEGIN_POINT targetPoint)
+{
+	int32_t result = NO_ERROR;
+
+	if (mInited || !mFrontValid) {
+		result = ORDER_ERROR;
+	}
+	else if (mOutputNum >= DCS_MAX_OUTPUT_NUM) {
+		result = INVALID_PARAM;
+	}
+	else if (frontScaledInfo.width > mFrontInfo.width ||
+		frontScaledInfo.height > mFrontInfo.height) {
+		result = INVALID_PARAM;
+	}
+
+	if (SUCCESS(result)) {
+		// every engine gets its PiP already scaled, so its ProcessDownScale() is a no-op
+		DUAL_CAM_SYNTHESIS_PARAM* param = &mOutputParam[mOutputNum];
+		memcpy(&param->inputFrontInfo, &frontScaledInfo, sizeof(IMG_INFO));
+		memcpy(&param->frontScaledInfo, &frontScaledInfo, sizeof(IMG_INFO));
+		memcpy(&param->inputBackInfo, &backInfo, sizeof(IMG_INFO));
+		param->frontScaledInfo.bufSize =
+			getAlignedStride(frontScaledInfo.width, frontScaledInfo.stride) *
+			getAlignedStride(frontScaledInfo.height, frontScaledInfo.scanline) * 3 / 2;
+		param->inputFrontInfo.bufSize = param->frontScaledInfo.bufSize;
+		param->targetPoint = targetPoint;
+		mOutputNum++;
+	}
+
+	return result;
+}
+
+int32_t MultiSynthesisEngine::Initialize()
+{
+	int32_t result = NO_ERROR;
+	uint32_t pyramidSize = 0;
+	uint32_t pipSize = 0;
+
+	// the failure path below calls Deinit(), which must not hit a running engine
+	if (mInited) {
+		return ORDER_ERROR;
+	}
+
+	if (!mFrontValid || mOutputNum == 0) {
+		result = ORDER_ERROR;
+	}
+
+	// level i is half of level i-1, only build the levels some output needs
+	if (SUCCESS(result)) {
+		mLevelNum = 1;
+		mLevelW[0] = mFrontInfo.width;
+		mLevelH[0] = mFrontInfo.height;
+		for (uint32_t i = 0; i < mOutputNum; i++) {
+			uint32_t level = 0;
+			uint32_t w = mFrontInfo.width;
+			uint32_t h = mFrontInfo.height;
+			while (level + 1 < DCS_MAX_PYRAMID_LEVEL &&
+				((w / 2) & ~1) >= mOutputParam[i].frontScaledInfo.width &&
+				((h / 2) & ~1) >= mOutputParam[i].frontScaledInfo.height) {
+				w = (w / 2) & ~1;
+				h = (h / 2) & ~1;
+				level++;
+			}
+			mOutputLevel[i] = level;
+			if (level + 1 > mLevelNum) {
+				mLevelNum = level + 1;
+			}
+			if (mOutputParam[i].frontScaledInfo.bufSize > pipSize) {
+				pipSize = mOutputParam[i].frontScaledInfo.bufSize;
+			}
+		}
+		for (uint32_t i = 1; i < mLevelNum; i++) {
+			mLevelW[i] = (mLevelW[i - 1] / 2) & ~1;
+			mLevelH[i] = (mLevelH[i - 1] / 2) & ~1;
+			pyramidSize += mLevelW[i] * mLevelH[i] * 3 / 2;
+		}
+	}
+
+	if (SUCCESS(result) && pyramidSize > 0) {
+		mPyramidBuf = new uint8_t[pyramidSize];
+		if (mPyramidBuf == nullptr) {
+			result = NO_MEMORY;
+		}
+	}
+
+	if (SUCCESS(result)) {
+		mPipBuf = new uint8_t[pipSize];
+		if (mPipBuf == nullptr) {
+			result = NO_MEMORY;
+		}
+	}
+
+	if (SUCCESS(result)) {
+		uint8_t* levelBuf = mPyramidBuf;
+		for (uint32_t i = 1; i < mLevelNum; i++) {
+			mLevelY[i] = levelBuf;
+			mLevelUV[i] = levelBuf + mLevelW[i] * mLevelH[i];
+			levelBuf += mLevelW[i] * mLevelH[i] * 3 / 2;
+		}
+	}
+
+	for (uint32_t i = 0; i < mOutputNum && SUCCESS(result); i++) {
+		result = mEngine[i].SetParams(mOutputParam[i]);
+		if (SUCCESS(result)) {
+			result = mEngine[i].Initialize();
+		}
+	}
+
+	if (SUCCESS(result)) {
+		mInited = true;
+	}
+	else {
+		Deinit();
+	}
+
+	return result;
+}
+
+int32_t MultiSynthesisEngine::Deinit()
+{
+	int32_t result = NO_ERROR;
+
+	for (uint32_t i = 0; i < mOutputNum; i++) {
+		mEngine[i].Deinit();
+	}
+	delete[] mPyramidBuf;
+	mPyramidBuf = nullptr;
+	delete[] mPipBuf;
+	mPipBuf = nullptr;
+	mLevelNum = 0;
+	mOutputNum = 0;
+	mFrontValid = false;
+	mInited = false;
+
+	return result;
+}
+
+int32_t MultiSynthesisEngine::BuildPyramid(uint8_t* frontData)
+{
+	int32_t result = NO_ERROR;
+
+	int32_t alignedW = getAlignedStride(mFrontInfo.width, mFrontInfo.stride);
+	int32_t alignedH = getAlignedStride(mFrontInfo.height, mFrontInfo.scanline);
+	mLevelY[0] = frontData;
+	mLevelUV[0] = frontData + alignedW * alignedH;
+
+	for (uint32_t i = 1; i < mLevelNum && SUCCESS(result); i++) {
+		int32_t srcStride = (i == 1) ? alignedW : mLevelW[i - 1];
+		result = libyuv::NV12Scale(mLevelY[i - 1], srcStride, mLevelUV[i - 1], srcStride,
+			mLevelW[i - 1], mLevelH[i - 1],
+			mLevelY[i], mLevelW[i], mLevelUV[i], mLevelW[i],
+			mLevelW[i], mLevelH[i],
+			libyuv::kFilterBox);
+	}
+
+	return (result == 0) ? NO_ERROR : INVALID_PARAM;
+}
+
+int32_t MultiSynthesisEngine::ProcessSynthesis(void* frontData, void** backData,
+	uint32_t backNum)
+{
+	int32_t result = NO_ERROR;
+
+	if (frontData == nullptr || backData == nullptr) {
+		result = EMPTY_INPUT;
+	}
+	else if (!mInited) {
+		result = NOT_INITED;
+	}
+	else if (backNum != mOutputNum) {
+		result = INVALID_PARAM;
+	}
+
+	if (SUCCESS(result)) {
+		result = BuildPyramid(static_cast<uint8_t*>(frontData));
+	}
+
+	for (uint32_t i = 0; i < mOutputNum && SUCCESS(result); i++) {
+		IMG_INFO* scaled = &mOutputParam[i].frontScaledInfo;
+		uint32_t level = mOutputLevel[i];
+		int32_t srcStride = (level == 0) ?
+			getAlignedStride(mFrontInfo.width, mFrontInfo.stride) : mLevelW[level];
+		int32_t alignedPW = getAlignedStride(scaled->width, scaled->stride);
+		int32_t alignedPH = getAlignedStride(scaled->height, scaled->scanline);
+
+		if (backData[i] == nullptr) {
+			result = EMPTY_INPUT;
+		}
+
+		if (SUCCESS(result)) {
+			result = libyuv::NV12Scale(mLevelY[level], srcStride, mLevelUV[level], srcStride,
+				mLevelW[level], mLevelH[level],
+				mPipBuf, alignedPW, mPipBuf + alignedPW * alignedPH, alignedPW,
+				scaled->width, scaled->height,
+				libyuv::kFilterBilinear);
+			result = (result == 0) ? NO_ERROR : INVALID_PARAM;
+		}
+
+		if (SUCCESS(result)) {
+			result = mEngine[i].ProcessDownScale(mPipBuf);
+		}
+
+		if (SUCCESS(result)) {
+			result = mEngine[i].ProcessSynthesis(mPipBuf, backData[i]);
+		}
+	}
+
+	return result;
+}
+
+int32_t MultiSynthesisEngine::UpdateTargetPoint(uint32_t index, BEGIN_POINT point)
+{
+	if (index >= mOutputNum) {
+		return INVALID_PARAM;
+	}
+
+	mOutputParam[index].targetPoint = point;
+	return mEngine[index].UpdateTargetPoint(point);
+}
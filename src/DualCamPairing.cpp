@@ -0,0 +1,321 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// Author: Peng Hao
+// License: GPL
+//////////////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////////////
+// @file: DualCamPairing.cpp
+// @brief: Pair front and back frames from two unsynchronized sensors by timestamp,
+//      and feed every fresh back frame with its nearest front to SynthesisEngine.
+//////////////////////////////////////////////////////////////////////////////////////
+
+#include "DualCamPairing.h"
+
+
+static uint64_t TimeDistance(uint64_t a, uint64_t b)
+{
+	return (a > b) ? a - b : b - a;
+}
+
+PairingScheduler::PairingScheduler()
+	:mInited(false)
+	,mEngine(nullptr)
+	,mReleaseFunc(nullptr)
+	,mUserData(nullptr)
+	,mFrontHead(0)
+	,mFrontCount(0)
+	,mBackHead(0)
+	,mBackCount(0)
+	,mLastScaled(nullptr)
+	,mLastScaledSize(0)
+	,mHasScaled(false)
+{
+	memset(&mStats, 0, sizeof(DUAL_CAM_PAIRING_STATS));
+}
+
+PairingScheduler::~PairingScheduler()
+{
+	Deinit();
+}
+
+int32_t PairingScheduler::Initialize(SynthesisEngine* engine, DUAL_CAM_PAIRING_PARAM param,
+	DCS_FRAME_RELEASE_FUNC releaseFunc, void* userData)
+{
+	int32_t result = NO_ERROR;
+	DUAL_CAM_SYNTHESIS_PARAM engineParam;
+
+	if (engine == nullptr || releaseFunc == nullptr) {
+		result = EMPTY_INPUT;
+	}
+	else if (!engine->mInited) {
+		result = ORDER_ERROR;
+	}
+
+	if (SUCCESS(result)) {
+		result = engine->GetParams(&engineParam);
+	}
+
+	if (SUCCESS(result)) {
+		mLastScaledSize = getAlignedStride(engineParam.frontScaledInfo.width,
+			engineParam.frontScaledInfo.stride) *
+			getAlignedStride(engineParam.frontScaledInfo.height,
+			engineParam.frontScaledInfo.scanline) * 3 / 2;
+		mLastScaled = new uint8_t[mLastScaledSize];
+		if (mLastScaled == nullptr) {
+			result = NO_MEMORY;
+		}
+	}
+
+	if (SUCCESS(result)) {
+		mEngine = engine;
+		mParam = param;
+		mReleaseFunc = releaseFunc;
+		mUserData = userData;
+		mFrontHead = mFrontCount = 0;
+		mBackHead = mBackCount = 0;
+		mHasScaled = false;
+		memset(&mStats, 0, sizeof(DUAL_CAM_PAIRING_STATS));
+		mInited = true;
+	}
+
+	return result;
+}
+
+int32_t PairingScheduler::Deinit()
+{
+	int32_t result = NO_ERROR;
+	FRAME_ENTRY pending[DCS_PAIRING_QUEUE_SIZE * 2];
+	uint32_t pendingNum = 0;
+
+	{
+		std::lock_guard<std::mutex> guard(mLock);
+		if (mInited) {
+			while (mFrontCount > 0) {
+				pending[pendingNum++] = Pop(mFrontQueue, &mFrontHead, &mFrontCount);
+			}
+			while (mBackCount > 0) {
+				pending[pendingNum++] = Pop(mBackQueue, &mBackHead, &mBackCount);
+			}
+		}
+		delete[] mLastScaled;
+		mLastScaled = nullptr;
+		mHasScaled = false;
+		mInited = false;
+	}
+
+	for (uint32_t i = 0; i < pendingNum; i++) {
+		Release(pending[i], true);
+	}
+
+	return result;
+}
+
+int32_t PairingScheduler::PushFront(void* data, uint64_t timestamp)
+{
+	int32_t result = NO_ERROR;
+	FRAME_ENTRY evicted = { nullptr, 0 };
+
+	{
+		std::lock_guard<std::mutex> guard(mLock);
+		if (!mInited) {
+			result = NOT_INITED;
+		}
+		else {
+			result = PushLocked(mFrontQueue, &mFrontHead, &mFrontCount, &mStats.frontDropped,
+				data, timestamp, &evicted);
+		}
+	}
+	Release(evicted, true);
+
+	return result;
+}
+
+int32_t PairingScheduler::PushBack(void* data, uint64_t timestamp)
+{
+	int32_t result = NO_ERROR;
+	FRAME_ENTRY evicted = { nullptr, 0 };
+
+	{
+		std::lock_guard<std::mutex> guard(mLock);
+		if (!mInited) {
+			result = NOT_INITED;
+		}
+		else {
+			result = PushLocked(mBackQueue, &mBackHead, &mBackCount, &mStats.backDropped,
+				data, timestamp, &evicted);
+		}
+	}
+	Release(evicted, true);
+
+	return result;
+}
+
+int32_t PairingScheduler::ProcessNext(void** backData, uint64_t* timestamp)
+{
+	int32_t result = NO_ERROR;
+	FRAME_ENTRY back = { nullptr, 0 };
+	FRAME_ENTRY front = { nullptr, 0 };
+	FRAME_ENTRY dropped[DCS_PAIRING_QUEUE_SIZE * 2];
+	uint32_t droppedNum = 0;
+	bool stale = false;
+
+	if (backData == nullptr || timestamp == nullptr) {
+		result = EMPTY_INPUT;
+	}
+	else {
+		*backData = nullptr;
+	}
+
+	if (SUCCESS(result)) {
+		std::lock_guard<std::mutex> guard(mLock);
+
+		if (!mInited) {
+			result = NOT_INITED;
+		}
+		else if (mBackCount == 0) {
+			result = EMPTY_INPUT;
+		}
+
+		// keep latency bounded: skip back frames which are too old to be shown
+		if (SUCCESS(result)) {
+			uint64_t newest = mBackQueue[(mBackHead + mBackCount - 1) % DCS_PAIRING_QUEUE_SIZE].timestamp;
+			while (mBackCount > 1 &&
+				mBackQueue[mBackHead].timestamp + mParam.latencyBudget < newest) {
+				dropped[droppedNum++] = Pop(mBackQueue, &mBackHead, &mBackCount);
+				mStats.backDropped++;
+			}
+			back = Pop(mBackQueue, &mBackHead, &mBackCount);
+		}
+
+		// back timestamps only grow, so a front which is not the nearest one now
+		// will never be the nearest one for a later back frame either.
+		// the newest front up to back + tolerance is kept even if it is older than
+		// back - tolerance: it is still newer than the last scaled one
+		while (SUCCESS(result) && mFrontCount > 0) {
+			FRAME_ENTRY oldest = mFrontQueue[mFrontHead];
+			if (oldest.timestamp > back.timestamp + mParam.tolerance) {
+				break;
+			}
+
+			bool nextIsNearer = false;
+			if (mFrontCount > 1) {
+				FRAME_ENTRY next = mFrontQueue[(mFrontHead + 1) % DCS_PAIRING_QUEUE_SIZE];
+				nextIsNearer = next.timestamp <= back.timestamp + mParam.tolerance &&
+					TimeDistance(next.timestamp, back.timestamp) <=
+					TimeDistance(oldest.timestamp, back.timestamp);
+			}
+
+			if (nextIsNearer) {
+				dropped[droppedNum++] = Pop(mFrontQueue, &mFrontHead, &mFrontCount);
+				mStats.frontDropped++;
+			}
+			else {
+				front = Pop(mFrontQueue, &mFrontHead, &mFrontCount);
+				stale = front.timestamp + mParam.tolerance < back.timestamp;
+				break;
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < droppedNum; i++) {
+		Release(dropped[i], true);
+	}
+
+	if (SUCCESS(result) && front.data != nullptr) {
+		result = mEngine->ProcessDownScale(front.data);
+		if (SUCCESS(result)) {
+			memcpy(mLastScaled, front.data, mLastScaledSize);
+			mHasScaled = true;
+		}
+		Release(front, !SUCCESS(result));
+	}
+
+	if (SUCCESS(result)) {
+		if (mHasScaled) {
+			result = mEngine->ProcessSynthesis(mLastScaled, back.data);
+		}
+
+		std::lock_guard<std::mutex> guard(mLock);
+		if (front.data != nullptr && stale) {
+			mStats.frontStale++;
+		}
+		else if (front.data != nullptr) {
+			mStats.paired++;
+		}
+		else if (mHasScaled) {
+			mStats.frontReused++;
+		}
+		else {
+			mStats.noFront++;
+		}
+	}
+
+	// a back frame which could not be composited goes back through the callback
+	if (SUCCESS(result)) {
+		*backData = back.data;
+		*timestamp = back.timestamp;
+	}
+	else {
+		Release(back, true);
+	}
+
+	return result;
+}
+
+int32_t PairingScheduler::GetStats(DUAL_CAM_PAIRING_STATS* stats)
+{
+	if (stats == nullptr) {
+		return EMPTY_INPUT;
+	}
+
+	std::lock_guard<std::mutex> guard(mLock);
+	mStats.frontQueueDepth = mFrontCount;
+	mStats.backQueueDepth = mBackCount;
+	memcpy(stats, &mStats, sizeof(DUAL_CAM_PAIRING_STATS));
+
+	return NO_ERROR;
+}
+
+int32_t PairingScheduler::PushLocked(FRAME_ENTRY* queue, uint32_t* head, uint32_t* count,
+	uint32_t* dropped, void* data, uint64_t timestamp, FRAME_ENTRY* evicted)
+{
+	if (data == nullptr) {
+		return EMPTY_INPUT;
+	}
+
+	// frames have to come in timestamp order
+	if (*count > 0 &&
+		queue[(*head + *count - 1) % DCS_PAIRING_QUEUE_SIZE].timestamp > timestamp) {
+		return INVALID_PARAM;
+	}
+
+	// queue full, the oldest frame is the least useful one, the caller
+	// releases it once the lock is dropped
+	if (*count == DCS_PAIRING_QUEUE_SIZE) {
+		*evicted = Pop(queue, head, count);
+		(*dropped)++;
+	}
+
+	queue[(*head + *count) % DCS_PAIRING_QUEUE_SIZE].data = data;
+	queue[(*head + *count) % DCS_PAIRING_QUEUE_SIZE].timestamp = timestamp;
+	(*count)++;
+
+	return NO_ERROR;
+}
+
+PairingScheduler::FRAME_ENTRY PairingScheduler::Pop(FRAME_ENTRY* queue,
+	uint32_t* head, uint32_t* count)
+{
+	FRAME_ENTRY entry = queue[*head];
+	*head = (*head + 1) % DCS_PAIRING_QUEUE_SIZE;
+	(*count)--;
+
+	return entry;
+}
+
+void PairingScheduler::Release(FRAME_ENTRY entry, bool dropped)
+{
+	if (mReleaseFunc != nullptr && entry.data != nullptr) {
+		mReleaseFunc(entry.data, entry.timestamp, dropped, mUserData);
+	}
+}
@@ -11,7 +11,9 @@
 //////////////////////////////////////////////////////////////////////////////////////
 
 #include "DualCamSynthesis.h"
+#include "DualCamFixedMode.h"
 #include "libyuv.h"
+#include <chrono>
 
 
 size_t getAlignedStride(int32_t num, int32_t stride)
@@ -19,12 +21,41 @@ size_t getAlignedStride(int32_t num, int32_t stride)
 	return (stride > 1) ? GET_ALIGNED(num, stride) : num;
 }
 
+static uint64_t GetTimeUs()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 
 SynthesisEngine::SynthesisEngine()
 	:mInited(false)
 	,mParamValid(false)
 	,mScaled(false)
+	,mScaleBuf(nullptr)
+	,mScaleFilter(libyuv::kFilterBilinear)
+	,mTimeBudget(0)
+	,mQualityTier(DCS_TIER_BILINEAR)
+	,mFrameCost(0)
+	,mAvgCost(0)
+	,mHeadroomFrames(0)
+	,mTierHoldFrames(0)
+	,mFrameCount(0)
+	,mLastScaled(nullptr)
+	,mHasLastScaled(false)
+	,mAutoTune(false)
+	,mTuneBudgetMs(0)
+	,mStripMode(false)
+	,mStripRing(nullptr)
+	,mStripXTab(nullptr)
+	,mFixedModeEnable(true)
+	,mDisplayEnabled(false)
+	,mDisplaySaved(false)
+	,mDisplaySaveBuf(nullptr)
+	,mDisplayPipBuf(nullptr)
 {
+	mTuneCachePath[0] = '\0';
+	memset(mFixedPaste, 0, sizeof(mFixedPaste));
 }
 
 SynthesisEngine::~SynthesisEngine() 
@@ -39,22 +70,63 @@ int32_t SynthesisEngine::Initialize()
 	mOverRangeState = NO_OVERRANGE;
 	mMirrorFlipState = NEEDNOT; //less time cosumption
 
-	if (mParamValid) {
+	// a cached tuning result picks the scaler before anything is allocated
+	bool stripMode = mStripMode;
+	bool tuning = mParamValid && mAutoTune && !SUCCESS(LoadTuneCache());
+
+	if (mParamValid && (mStripMode || tuning)) {
+		int32_t alignedDstW = getAlignedStride(mParam.frontScaledInfo.width,
+			mParam.frontScaledInfo.stride);
+		mStripRing = new uint8_t[DCS_STRIP_RING_ROWS * alignedDstW];
+		mStripXTab = new int32_t[alignedDstW];
+
+		if (mStripRing == nullptr || mStripXTab == nullptr) {
+			result = NO_MEMORY;
+		}
+		else {
+			mInited = true;
+			result = NO_ERROR;
+		}
+	}
+
+	if (mParamValid && (!mStripMode || tuning) && result != NO_MEMORY) {
 		mScaleBuf = new uint8_t[mParam.frontScaledInfo.bufSize];
 		memset(mScaleBuf, 0, mParam.frontScaledInfo.bufSize);
 
 		if (mScaleBuf == nullptr) {
 			result = NO_MEMORY;
+			mInited = false;
 		}
 		else {
 			mInited = true;
 			result = NO_ERROR;
 		}
 	}
-	else {
+
+	if (!mParamValid) {
 		result = ORDER_ERROR;
 	}
 
+	if (SUCCESS(result) && tuning) {
+		result = AutoTune();
+	}
+
+	// a failed tuning leaves buffers of both scalers behind
+	if (!SUCCESS(result) && tuning) {
+		delete[] mScaleBuf;
+		mScaleBuf = nullptr;
+		delete[] mStripRing;
+		mStripRing = nullptr;
+		delete[] mStripXTab;
+		mStripXTab = nullptr;
+		mStripMode = stripMode;
+		mInited = false;
+	}
+
+	if (SUCCESS(result)) {
+		UpdateFixedMode();
+	}
+
 	return result;
 }
 
@@ -63,6 +135,21 @@ int32_t SynthesisEngine::Deinit() {
 
 	delete[] mScaleBuf;
 	mScaleBuf = nullptr;
+	delete[] mStripRing;
+	mStripRing = nullptr;
+	delete[] mStripXTab;
+	mStripXTab = nullptr;
+	delete[] mLastScaled;
+	mLastScaled = nullptr;
+	mHasLastScaled = false;
+	mTimeBudget = 0;
+	SetQualityTier(DCS_TIER_BILINEAR);
+	delete[] mDisplaySaveBuf;
+	mDisplaySaveBuf = nullptr;
+	delete[] mDisplayPipBuf;
+	mDisplayPipBuf = nullptr;
+	mDisplayEnabled = false;
+	mDisplaySaved = false;
 	mInited = false;
 	mScaled = false;
 	mParamValid = false;
@@ -70,7 +157,150 @@ int32_t SynthesisEngine::Deinit() {
 	return result;
 }
 
-int32_t SynthesisEngine::ProcessDownScale(void* src) {
+int32_t SynthesisEngine::ProcessDownScale(void* src)
+{
+	int32_t result = NO_ERROR;
+	uint64_t begin = GetTimeUs();
+	uint8_t* dataY = static_cast<uint8_t*>(src);
+	uint32_t sizeY = getAlignedStride(mParam.frontScaledInfo.width, mParam.frontScaledInfo.stride) *
+		getAlignedStride(mParam.frontScaledInfo.height, mParam.frontScaledInfo.scanline);
+
+	if (src != nullptr && ReuseLastScaled()) {
+		memcpy(dataY, mLastScaled, sizeY * 3 / 2);
+		mScaled = true;
+	}
+	else {
+		result = ScaleFront(src);
+		if (SUCCESS(result) && mLastScaled != nullptr) {
+			memcpy(mLastScaled, dataY, sizeY * 3 / 2);
+			mHasLastScaled = true;
+		}
+	}
+
+	mFrameCost += GetTimeUs() - begin;
+	return result;
+}
+
+int32_t SynthesisEngine::ProcessDownScale(void* dataY, void* dataUV)
+{
+	int32_t result = NO_ERROR;
+	uint64_t begin = GetTimeUs();
+	uint32_t sizeY = getAlignedStride(mParam.frontScaledInfo.width, mParam.frontScaledInfo.stride) *
+		getAlignedStride(mParam.frontScaledInfo.height, mParam.frontScaledInfo.scanline);
+
+	if (dataY != nullptr && dataUV != nullptr && ReuseLastScaled()) {
+		memcpy(dataY, mLastScaled, sizeY);
+		memcpy(dataUV, mLastScaled + sizeY, sizeY / 2);
+		mScaled = true;
+	}
+	else {
+		result = ScaleFront(dataY, dataUV);
+		if (SUCCESS(result) && mLastScaled != nullptr) {
+			memcpy(mLastScaled, dataY, sizeY);
+			memcpy(mLastScaled + sizeY, dataUV, sizeY / 2);
+			mHasLastScaled = true;
+		}
+	}
+
+	mFrameCost += GetTimeUs() - begin;
+	return result;
+}
+
+int32_t SynthesisEngine::ProcessSynthesis(void* frontData, void* backData)
+{
+	int32_t result = NO_ERROR;
+	uint64_t begin = GetTimeUs();
+
+	result = PasteFront(frontData, backData);
+
+	mFrameCost += GetTimeUs() - begin;
+	UpdateQualityTier();
+	return result;
+}
+
+int32_t SynthesisEngine::ProcessSynthesis(
+	void* frontDataY, void* frontDataUV,
+	void* backDataY, void* backDataUV)
+{
+	int32_t result = NO_ERROR;
+	uint64_t begin = GetTimeUs();
+
+	result = PasteFront(frontDataY, frontDataUV, backDataY, backDataUV);
+
+	mFrameCost += GetTimeUs() - begin;
+	UpdateQualityTier();
+	return result;
+}
+
+bool SynthesisEngine::ReuseLastScaled()
+{
+	// at DCS_TIER_REUSE_SCALED and below, front is only scaled every other frame
+	return mQualityTier >= DCS_TIER_REUSE_SCALED && mHasLastScaled &&
+		mScaled && mFrameCount % 2 == 1;
+}
+
+void SynthesisEngine::UpdateQualityTier()
+{
+	uint64_t cost = mFrameCost;
+	mFrameCost = 0;
+	mFrameCount++;
+
+	if (mTimeBudget == 0) {
+		return;
+	}
+
+	mAvgCost = (mAvgCost == 0) ? cost : (mAvgCost * 3 + cost) / 4;
+
+	// give the last tier change some frames to show up in mAvgCost
+	if (mTierHoldFrames > 0) {
+		mTierHoldFrames--;
+		return;
+	}
+
+	// strip scaler is always bilinear, its filter tiers would change nothing
+	if (mAvgCost * 100 > (uint64_t)mTimeBudget * DCS_TIER_DEGRADE_RATIO) {
+		mHeadroomFrames = 0;
+		if (mQualityTier < DCS_TIER_NO_MIRROR) {
+			int32_t tier = mQualityTier + 1;
+			if (mStripMode && tier <= DCS_TIER_NEAREST) {
+				tier = DCS_TIER_REUSE_SCALED;
+			}
+			SetQualityTier(tier);
+		}
+	}
+	else if (mAvgCost * 100 < (uint64_t)mTimeBudget * DCS_TIER_CLIMB_RATIO) {
+		mHeadroomFrames++;
+		if (mHeadroomFrames >= DCS_TIER_CLIMB_FRAMES && mQualityTier > DCS_TIER_BILINEAR) {
+			int32_t tier = mQualityTier - 1;
+			if (mStripMode && tier <= DCS_TIER_NEAREST) {
+				tier = DCS_TIER_BILINEAR;
+			}
+			mHeadroomFrames = 0;
+			SetQualityTier(tier);
+		}
+	}
+	else {
+		mHeadroomFrames = 0;
+	}
+}
+
+void SynthesisEngine::SetQualityTier(int32_t tier)
+{
+	mQualityTier = tier;
+	mTierHoldFrames = DCS_TIER_HOLD_FRAMES;
+
+	if (tier == DCS_TIER_BILINEAR) {
+		mScaleFilter = libyuv::kFilterBilinear;
+	}
+	else if (tier == DCS_TIER_LINEAR) {
+		mScaleFilter = libyuv::kFilterLinear;
+	}
+	else {
+		mScaleFilter = libyuv::kFilterNone;
+	}
+}
+
+int32_t SynthesisEngine::ScaleFront(void* src) {
 	int32_t result = NO_ERROR;
 	mOverRangeState = NO_OVERRANGE;
 
@@ -104,6 +334,14 @@ int32_t SynthesisEngine::ProcessDownScale(void* src) {
 		}
 	}
 
+	if (SUCCESS(result) && mStripMode) {
+		srcY = static_cast<uint8_t*>(src);
+		result = ProcessStripDownScale(srcY, srcY + alignedSrcW * alignedSrcH,
+			srcY, srcY + alignedDstW * alignedDstH);
+		mScaled = SUCCESS(result);
+		return result;
+	}
+
 	if (SUCCESS(result)) {
 		memcpy(mScaleBuf, src, mParam.inputFrontInfo.bufSize);
 	}
@@ -137,7 +375,7 @@ int32_t SynthesisEngine::ProcessDownScale(void* src) {
 			mParam.inputFrontInfo.width, mParam.inputFrontInfo.height,
 			srcY, alignedDstW, srcUI420, alignedDstW / 2, srcVI420, alignedDstW / 2,
 			mParam.frontScaledInfo.width, mParam.frontScaledInfo.height,
-			libyuv::kFilterBilinear);
+			static_cast<libyuv::FilterMode>(mScaleFilter));
 	}
 
 	if (SUCCESS(result)) {
@@ -159,7 +397,7 @@ int32_t SynthesisEngine::ProcessDownScale(void* src) {
 	return result;
 }
 
-int32_t SynthesisEngine::ProcessDownScale(void* dataY, void* dataUV) {
+int32_t SynthesisEngine::ScaleFront(void* dataY, void* dataUV) {
 	int32_t result = NO_ERROR;
 	mOverRangeState = NO_OVERRANGE;
 
@@ -191,6 +429,13 @@ int32_t SynthesisEngine::ProcessDownScale(void* dataY, void* dataUV) {
 		}
 	}
 
+	if (SUCCESS(result) && mStripMode) {
+		result = ProcessStripDownScale(static_cast<uint8_t*>(dataY), static_cast<uint8_t*>(dataUV),
+			static_cast<uint8_t*>(dataY), static_cast<uint8_t*>(dataUV));
+		mScaled = SUCCESS(result);
+		return result;
+	}
+
 	if (SUCCESS(result)) {
 		memcpy(mScaleBuf, dataY, alignedSrcW * alignedSrcH);
 		memcpy(mScaleBuf + alignedSrcW * alignedSrcH, dataUV, alignedSrcW * alignedSrcH / 2);
@@ -225,7 +470,7 @@ int32_t SynthesisEngine::ProcessDownScale(void* dataY, void* dataUV) {
 			mParam.inputFrontInfo.width, mParam.inputFrontInfo.height,
 			srcY, alignedDstW, srcUI420, alignedDstW / 2, srcVI420, alignedDstW / 2,
 			mParam.frontScaledInfo.width, mParam.frontScaledInfo.height, 
-			libyuv::kFilterBilinear);
+			static_cast<libyuv::FilterMode>(mScaleFilter));
 	}
 
 	if (SUCCESS(result)) {
@@ -247,7 +492,95 @@ int32_t SynthesisEngine::ProcessDownScale(void* dataY, void* dataUV) {
 	return result;
 }
 
-int32_t SynthesisEngine::ProcessSynthesis(void* frontData, void* backData)
+int32_t SynthesisEngine::ProcessStripDownScale(uint8_t* srcY, uint8_t* srcUV,
+	uint8_t* dstY, uint8_t* dstUV)
+{
+	int32_t result = NO_ERROR;
+
+	int32_t alignedSrcW = getAlignedStride(mParam.inputFrontInfo.width,
+		mParam.inputFrontInfo.stride);
+	int32_t alignedDstW = getAlignedStride(mParam.frontScaledInfo.width,
+		mParam.frontScaledInfo.stride);
+
+	if (mStripRing == nullptr || mStripXTab == nullptr) {
+		result = NOT_INITED;
+	}
+
+	// Y first, then UV. Scaled plane is never bigger than the source plane, so
+	// scaled row n only overwrites source rows which are already in the ring.
+	if (SUCCESS(result)) {
+		StripScalePlane(srcY, alignedSrcW,
+			mParam.inputFrontInfo.width, mParam.inputFrontInfo.height,
+			dstY, alignedDstW,
+			mParam.frontScaledInfo.width, mParam.frontScaledInfo.height, 1);
+		StripScalePlane(srcUV, alignedSrcW,
+			mParam.inputFrontInfo.width / 2, mParam.inputFrontInfo.height / 2,
+			dstUV, alignedDstW,
+			mParam.frontScaledInfo.width / 2, mParam.frontScaledInfo.height / 2, 2);
+	}
+
+	return result;
+}
+
+void SynthesisEngine::StripScalePlane(uint8_t* src, int32_t srcStride, int32_t srcW, int32_t srcH,
+	uint8_t* dst, int32_t dstStride, int32_t dstW, int32_t dstH, int32_t bpp)
+{
+	int32_t ringRow[DCS_STRIP_RING_ROWS];
+	int32_t maxX = (srcW - 1) << 16;
+	int32_t maxY = (srcH - 1) << 16;
+
+	for (int32_t i = 0; i < DCS_STRIP_RING_ROWS; i++) {
+		ringRow[i] = -1;
+	}
+
+	// bilinear with pixel centers aligned, positions are 16.16 fixed point and
+	// stepped the way libyuv does, so both scalers sample the same positions
+	int32_t dx = (int32_t)(((int64_t)srcW << 16) / dstW);
+	int32_t dy = (int32_t)(((int64_t)srcH << 16) / dstH);
+	for (int32_t col = 0; col < dstW; col++) {
+		int64_t x = (dx >> 1) - 32768 + (int64_t)col * dx;
+		x = (x < 0) ? 0 : (x > maxX) ? maxX : x;
+		mStripXTab[col] = (int32_t)x;
+	}
+
+	for (int32_t row = 0; row < dstH; row++) {
+		int64_t y = (dy >> 1) - 32768 + (int64_t)row * dy;
+		y = (y < 0) ? 0 : (y > maxY) ? maxY : y;
+		int32_t y0 = (int32_t)(y >> 16);
+		int32_t y1 = (y0 + 1 < srcH) ? y0 + 1 : y0;
+		int32_t fy = (int32_t)(y >> 8) & 0xff;
+		int32_t srcRow[2] = { y0, y1 };
+		uint8_t* line[2];
+
+		// source rows are only fetched in increasing order, once each
+		for (int32_t i = 0; i < 2; i++) {
+			int32_t slot = srcRow[i] % DCS_STRIP_RING_ROWS;
+			line[i] = mStripRing + slot * dstW * bpp;
+			if (ringRow[slot] != srcRow[i]) {
+				uint8_t* s = src + srcRow[i] * srcStride;
+				for (int32_t col = 0; col < dstW; col++) {
+					int32_t x0 = mStripXTab[col] >> 16;
+					int32_t x1 = (x0 + 1 < srcW) ? x0 + 1 : x0;
+					// 7 bit column weight, as libyuv's column filter
+					int32_t fx = (mStripXTab[col] >> 9) & 0x7f;
+					for (int32_t c = 0; c < bpp; c++) {
+						int32_t a = s[x0 * bpp + c];
+						line[i][col * bpp + c] = (uint8_t)(a +
+							((fx * (s[x1 * bpp + c] - a) + 64) >> 7));
+					}
+				}
+				ringRow[slot] = srcRow[i];
+			}
+		}
+
+		uint8_t* d = dst + row * dstStride;
+		for (int32_t i = 0; i < dstW * bpp; i++) {
+			d[i] = (uint8_t)((line[0][i] * (256 - fy) + line[1][i] * fy + 128) >> 8);
+		}
+	}
+}
+
+int32_t SynthesisEngine::PasteFront(void* frontData, void* backData)
 {
 	int32_t result = NO_ERROR;
 	mOverRangeState = NO_OVERRANGE;
@@ -283,6 +616,14 @@ int32_t SynthesisEngine::ProcessSynthesis(void* frontData, void* backData)
 		backUV = backY + alignedBW * alignedBH;
 		int32_t x = mParam.targetPoint.x;
 		int32_t y = mParam.targetPoint.y;
+		int32_t mirrorFlipState = (mQualityTier >= DCS_TIER_NO_MIRROR) ?
+			static_cast<int32_t>(NEEDNOT) : mMirrorFlipState;
+
+		// registered fixed camera mode, offsets and trip counts are compile time constants
+		if (mFixedModeEnable && mFixedPaste[mirrorFlipState] != nullptr) {
+			mFixedPaste[mirrorFlipState](frontY, frontUV, backY, backUV, x, y);
+			return result;
+		}
 
 		// need to think more about this segment.  this will lead to distortion for 1 pixel.
 		int32_t Yoffset = y * mParam.inputBackInfo.width + x;
@@ -301,7 +642,7 @@ int32_t SynthesisEngine::ProcessSynthesis(void* frontData, void* backData)
 		}
 
 		for (int32_t row = 0; row < mParam.frontScaledInfo.height; row++) {
-			switch (mMirrorFlipState) {
+			switch (mirrorFlipState) {
 			case NEED_X_MIRROR:
 				for (int32_t col = 0; col < mParam.frontScaledInfo.width; col++) {
 					backY[(row + y) * alignedBW + x + col] =
@@ -379,7 +720,7 @@ int32_t SynthesisEngine::ProcessSynthesis(void* frontData, void* backData)
 	return result;
 }
 
-int32_t SynthesisEngine::ProcessSynthesis(
+int32_t SynthesisEngine::PasteFront(
 	void* frontDataY, void* frontDataUV, 
 	void* backDataY, void* backDataUV)
 {
@@ -418,6 +759,14 @@ int32_t SynthesisEngine::ProcessSynthesis(
 		backUV = static_cast<uint8_t*>(backDataUV);
 		int32_t x = mParam.targetPoint.x;
 		int32_t y = mParam.targetPoint.y;
+		int32_t mirrorFlipState = (mQualityTier >= DCS_TIER_NO_MIRROR) ?
+			static_cast<int32_t>(NEEDNOT) : mMirrorFlipState;
+
+		// registered fixed camera mode, offsets and trip counts are compile time constants
+		if (mFixedModeEnable && mFixedPaste[mirrorFlipState] != nullptr) {
+			mFixedPaste[mirrorFlipState](frontY, frontUV, backY, backUV, x, y);
+			return result;
+		}
 
 		// need to think more about this segment.  this will lead to distortion for 1 pixel.
 		int32_t Yoffset = y * mParam.inputBackInfo.width + x;
@@ -436,7 +785,7 @@ int32_t SynthesisEngine::ProcessSynthesis(
 		}
 
 		for (int32_t row = 0; row < mParam.frontScaledInfo.height; row++) {
-			switch (mMirrorFlipState) {
+			switch (mirrorFlipState) {
 			case NEED_X_MIRROR:
 				for (int32_t col = 0; col < mParam.frontScaledInfo.width; col++) {
 					backY[(row + y) * alignedBW + x + col] =
@@ -514,6 +863,168 @@ int32_t SynthesisEngine::ProcessSynthesis(
 	return result;
 }
 
+int32_t SynthesisEngine::ProcessSynthesisDisplay(void* frontData, void* backData,
+	void* displayData, bool backUpdated)
+{
+	int32_t result = NO_ERROR;
+	uint8_t *frontUV = nullptr, *backUV = nullptr;
+
+	if (frontData == nullptr || backData == nullptr) {
+		result = EMPTY_INPUT;
+	}
+
+	if (SUCCESS(result)) {
+		int32_t alignedFW = getAlignedStride(mParam.frontScaledInfo.width,
+			mParam.inputFrontInfo.stride);
+		int32_t alignedFH = getAlignedStride(mParam.frontScaledInfo.height,
+			mParam.inputFrontInfo.scanline);
+		int32_t alignedBW = getAlignedStride(mParam.inputBackInfo.width,
+			mParam.inputBackInfo.stride);
+		int32_t alignedBH = getAlignedStride(mParam.inputBackInfo.height,
+			mParam.inputBackInfo.scanline);
+		frontUV = static_cast<uint8_t*>(frontData) + alignedFW * alignedFH;
+		backUV = static_cast<uint8_t*>(backData) + alignedBW * alignedBH;
+		result = ProcessSynthesisDisplay(frontData, frontUV, backData, backUV,
+			displayData, backUpdated);
+	}
+
+	return result;
+}
+
+int32_t SynthesisEngine::ProcessSynthesisDisplay(
+	void* frontDataY, void* frontDataUV,
+	void* backDataY, void* backDataUV,
+	void* displayData, bool backUpdated)
+{
+	int32_t result = NO_ERROR;
+	uint64_t begin = GetTimeUs();
+
+	uint8_t* display = static_cast<uint8_t*>(displayData);
+	int32_t alignedFW = getAlignedStride(mParam.frontScaledInfo.width,
+		mParam.inputFrontInfo.stride);
+	int32_t alignedBW = getAlignedStride(mParam.inputBackInfo.width,
+		mParam.inputBackInfo.stride);
+	int32_t displayStride = getAlignedStride(mDisplayInfo.width,
+		mDisplayInfo.stride) * 4;
+	int32_t pipW = mParam.frontScaledInfo.width;
+	int32_t pipH = mParam.frontScaledInfo.height;
+	uint8_t* pipDst = nullptr;
+
+	if (frontDataY == nullptr || frontDataUV == nullptr ||
+		backDataY == nullptr || backDataUV == nullptr || displayData == nullptr) {
+		result = EMPTY_INPUT;
+	}
+	else if (!mDisplayEnabled) {
+		result = ORDER_ERROR;
+	}
+	else if (!mScaled) {
+		result = ORDER_ERROR;
+	}
+	// back frame of last call already holds a PiP, it can not be the background,
+	// and without a saved rect there is nothing to restore displayData from
+	else if (!backUpdated && !mDisplaySaved) {
+		result = ORDER_ERROR;
+	}
+
+	// background has to be converted before the PiP is pasted into back frame
+	if (SUCCESS(result)) {
+		if (backUpdated) {
+			result = ConvertToDisplay(static_cast<uint8_t*>(backDataY), alignedBW,
+				static_cast<uint8_t*>(backDataUV), mParam.inputBackInfo.format,
+				display, displayStride, mDisplayInfo.width, mDisplayInfo.height);
+			mDisplaySaved = false;
+		}
+		else {
+			result = libyuv::ARGBCopy(mDisplaySaveBuf, pipW * 4,
+				display + mDisplaySavedPoint.y * displayStride + mDisplaySavedPoint.x * 4,
+				displayStride, pipW, pipH);
+		}
+	}
+
+	if (SUCCESS(result)) {
+		result = PasteFront(frontDataY, frontDataUV, backDataY, backDataUV);
+	}
+
+	// targetPoint has been fixed by PasteFront() if it was over range
+	if (SUCCESS(result)) {
+		pipDst = display + mParam.targetPoint.y * displayStride + mParam.targetPoint.x * 4;
+		result = libyuv::ARGBCopy(pipDst, displayStride,
+			mDisplaySaveBuf, pipW * 4, pipW, pipH);
+	}
+
+	if (SUCCESS(result)) {
+		mDisplaySavedPoint = mParam.targetPoint;
+		mDisplaySaved = true;
+	}
+
+	// PiP is converted from the scaled front directly, not from the pasted NV12
+	if (SUCCESS(result)) {
+		int32_t mirrorFlipState = (mQualityTier >= DCS_TIER_NO_MIRROR) ?
+			static_cast<int32_t>(NEEDNOT) : mMirrorFlipState;
+		switch (mirrorFlipState) {
+		case NEED_X_MIRROR:
+		case NEED_Y_FLIP:
+		case NEED_BOTH:
+			result = ConvertToDisplay(static_cast<uint8_t*>(frontDataY), alignedFW,
+				static_cast<uint8_t*>(frontDataUV), mParam.frontScaledInfo.format,
+				mDisplayPipBuf, pipW * 4, pipW, pipH);
+			if (SUCCESS(result)) {
+				// negative height means vertical flip in libyuv
+				int32_t height = (mirrorFlipState == NEED_X_MIRROR) ? pipH : -pipH;
+				if (mirrorFlipState == NEED_Y_FLIP) {
+					result = libyuv::ARGBCopy(mDisplayPipBuf, pipW * 4,
+						pipDst, displayStride, pipW, height);
+				}
+				else {
+					result = libyuv::ARGBMirror(mDisplayPipBuf, pipW * 4,
+						pipDst, displayStride, pipW, height);
+				}
+			}
+			break;
+		case NEEDNOT:
+		default:
+			result = ConvertToDisplay(static_cast<uint8_t*>(frontDataY), alignedFW,
+				static_cast<uint8_t*>(frontDataUV), mParam.frontScaledInfo.format,
+				pipDst, displayStride, pipW, pipH);
+		}
+	}
+
+	// the display conversion is part of the frame cost the tier has to cover
+	mFrameCost += GetTimeUs() - begin;
+	UpdateQualityTier();
+	return result;
+}
+
+int32_t SynthesisEngine::ConvertToDisplay(uint8_t* srcY, int32_t srcStride, uint8_t* srcUV,
+	uint32_t srcFormat, uint8_t* dst, int32_t dstStride, int32_t width, int32_t height)
+{
+	int32_t result = NO_ERROR;
+
+	// libyuv names ARGB by word order, so ARGB is B,G,R,A in memory
+	if (srcFormat == DCS_YUV420NV21) {
+		if (mDisplayInfo.format == DCS_DISPLAY_RGBA) {
+			result = libyuv::NV21ToABGR(srcY, srcStride, srcUV, srcStride,
+				dst, dstStride, width, height);
+		}
+		else {
+			result = libyuv::NV21ToARGB(srcY, srcStride, srcUV, srcStride,
+				dst, dstStride, width, height);
+		}
+	}
+	else {
+		if (mDisplayInfo.format == DCS_DISPLAY_RGBA) {
+			result = libyuv::NV12ToABGR(srcY, srcStride, srcUV, srcStride,
+				dst, dstStride, width, height);
+		}
+		else {
+			result = libyuv::NV12ToARGB(srcY, srcStride, srcUV, srcStride,
+				dst, dstStride, width, height);
+		}
+	}
+
+	return (result == 0) ? NO_ERROR : INVALID_PARAM;
+}
+
 int32_t SynthesisEngine::CheckParams() {
 	if (!mInited) {
 		return NOT_INITED;
@@ -608,10 +1119,24 @@ int32_t SynthesisEngine::SetParams(DUAL_CAM_SYNTHESIS_PARAM param)
 
 	memcpy(&mParam, &param, sizeof(DUAL_CAM_SYNTHESIS_PARAM));
 	mParamValid = true;
+	UpdateFixedMode();
 
 	return result;
 }
 
+int32_t SynthesisEngine::GetParams(DUAL_CAM_SYNTHESIS_PARAM* param)
+{
+	if (param == nullptr) {
+		return EMPTY_INPUT;
+	}
+	else if (!mParamValid) {
+		return ORDER_ERROR;
+	}
+
+	memcpy(param, &mParam, sizeof(DUAL_CAM_SYNTHESIS_PARAM));
+	return NO_ERROR;
+}
+
 int32_t SynthesisEngine::SetInitParams(uint32_t forntW, uint32_t frontH,
 	uint32_t scaledW, uint32_t scaledH,
 	uint32_t backW, uint32_t backH,
@@ -661,6 +1186,345 @@ int32_t SynthesisEngine::SetInitParams(uint32_t forntW, uint32_t frontH,
 	return result;
 }
 
+int32_t SynthesisEngine::SetDisplayParams(uint32_t format, uint32_t stride)
+{
+	int32_t result = NO_ERROR;
+	uint32_t pipSize = mParam.frontScaledInfo.width * mParam.frontScaledInfo.height * 4;
+
+	if (!mInited) {
+		result = NOT_INITED;
+	}
+	else if (format >= DCS_DISPLAY_NOT_SUPPORT) {
+		result = INVALID_PARAM;
+	}
+
+	if (SUCCESS(result)) {
+		mDisplayInfo.width = mParam.inputBackInfo.width;
+		mDisplayInfo.height = mParam.inputBackInfo.height;
+		mDisplayInfo.stride = stride;
+		mDisplayInfo.scanline = 0;
+		mDisplayInfo.bufSize = getAlignedStride(mDisplayInfo.width, stride) *
+			mDisplayInfo.height * 4;
+		mDisplayInfo.format = format;
+
+		delete[] mDisplaySaveBuf;
+		delete[] mDisplayPipBuf;
+		mDisplaySaveBuf = new uint8_t[pipSize];
+		mDisplayPipBuf = new uint8_t[pipSize];
+
+		if (mDisplaySaveBuf == nullptr || mDisplayPipBuf == nullptr) {
+			result = NO_MEMORY;
+		}
+		else {
+			mDisplayEnabled = true;
+			mDisplaySaved = false;
+		}
+	}
+
+	return result;
+}
+
+int32_t SynthesisEngine::SetStripMode(bool enable)
+{
+	if (mInited) {
+		return ORDER_ERROR;
+	}
+
+	mStripMode = enable;
+	return NO_ERROR;
+}
+
+int32_t SynthesisEngine::SetTimeBudget(uint32_t budgetUs)
+{
+	int32_t result = NO_ERROR;
+	uint32_t scaledSize = getAlignedStride(mParam.frontScaledInfo.width, mParam.frontScaledInfo.stride) *
+		getAlignedStride(mParam.frontScaledInfo.height, mParam.frontScaledInfo.scanline) * 3 / 2;
+
+	if (!mInited) {
+		result = NOT_INITED;
+	}
+
+	if (SUCCESS(result) && budgetUs > 0 && mLastScaled == nullptr) {
+		mLastScaled = new uint8_t[scaledSize];
+		if (mLastScaled == nullptr) {
+			result = NO_MEMORY;
+		}
+	}
+
+	// without adaptive quality nothing reuses the scaled front, stop copying it
+	if (SUCCESS(result) && budgetUs == 0) {
+		delete[] mLastScaled;
+		mLastScaled = nullptr;
+	}
+
+	if (SUCCESS(result)) {
+		mTimeBudget = budgetUs;
+		mAvgCost = 0;
+		mHeadroomFrames = 0;
+		mHasLastScaled = false;
+		SetQualityTier(DCS_TIER_BILINEAR);
+	}
+
+	return result;
+}
+
+int32_t SynthesisEngine::GetQualityTier()
+{
+	return mQualityTier;
+}
+
+int32_t SynthesisEngine::SetMirrorFlipState(int32_t state)
+{
+	if (!mInited) {
+		return NOT_INITED;
+	}
+	else if (state < NEEDNOT || state > NEED_BOTH) {
+		return INVALID_PARAM;
+	}
+
+	mMirrorFlipState = state;
+	return NO_ERROR;
+}
+
+int32_t SynthesisEngine::SetAutoTune(bool enable, uint32_t budgetMs, const char* cachePath)
+{
+	if (mInited) {
+		return ORDER_ERROR;
+	}
+
+	mAutoTune = enable;
+	mTuneBudgetMs = budgetMs;
+	mTuneCachePath[0] = '\0';
+	if (cachePath != nullptr) {
+		snprintf(mTuneCachePath, sizeof(mTuneCachePath), "%s", cachePath);
+	}
+	return NO_ERROR;
+}
+
+int32_t SynthesisEngine::GetScaler()
+{
+	return mStripMode ? DCS_SCALER_STRIP : DCS_SCALER_LIBYUV;
+}
+
+int32_t SynthesisEngine::AutoTune()
+{
+	int32_t result = NO_ERROR;
+	uint64_t bestCost[DCS_SCALER_NUM];
+	bool valid[DCS_SCALER_NUM];
+	int32_t best = DCS_SCALER_LIBYUV;
+	uint32_t srcSize = mParam.inputFrontInfo.bufSize;
+	uint32_t scaledSize = getAlignedStride(mParam.frontScaledInfo.width, mParam.frontScaledInfo.stride) *
+		getAlignedStride(mParam.frontScaledInfo.height, mParam.frontScaledInfo.scanline) * 3 / 2;
+
+	uint8_t* pattern = new uint8_t[srcSize];
+	uint8_t* work = new uint8_t[srcSize];
+	uint8_t* ref = new uint8_t[scaledSize];
+	if (pattern == nullptr || work == nullptr || ref == nullptr) {
+		result = NO_MEMORY;
+	}
+
+	// synthetic front: smooth gradient plus some noise, so filters do differ
+	if (SUCCESS(result)) {
+		uint32_t seed = 1;
+		for (uint32_t i = 0; i < srcSize; i++) {
+			seed = seed * 1103515245 + 12345;
+			pattern[i] = (uint8_t)((i / 7 + (seed >> 16 & 0x1f)) & 0xff);
+		}
+		for (int32_t i = 0; i < DCS_SCALER_NUM; i++) {
+			bestCost[i] = UINT64_MAX;
+			valid[i] = (i == DCS_SCALER_LIBYUV);
+		}
+	}
+
+	// libyuv is the reference, candidates are timed in turns until budget runs out
+	uint64_t deadline = GetTimeUs() + (uint64_t)mTuneBudgetMs * 1000;
+	for (uint32_t round = 0; SUCCESS(result) && round < DCS_TUNE_MAX_ROUNDS; round++) {
+		for (int32_t i = 0; i < DCS_SCALER_NUM && SUCCESS(result); i++) {
+			memcpy(work, pattern, srcSize);
+			mStripMode = (i == DCS_SCALER_STRIP);
+			uint64_t begin = GetTimeUs();
+			result = ScaleFront(work);
+			uint64_t cost = GetTimeUs() - begin;
+			if (cost < bestCost[i]) {
+				bestCost[i] = cost;
+			}
+			if (round == 0 && i == DCS_SCALER_LIBYUV) {
+				memcpy(ref, work, scaledSize);
+			}
+			else if (round == 0) {
+				valid[i] = true;
+				for (uint32_t j = 0; j < scaledSize && valid[i]; j++) {
+					int32_t diff = (int32_t)work[j] - (int32_t)ref[j];
+					valid[i] = (diff <= DCS_TUNE_MAX_DIFF && diff >= -DCS_TUNE_MAX_DIFF);
+				}
+			}
+		}
+		if (GetTimeUs() >= deadline) {
+			break;
+		}
+	}
+
+	if (SUCCESS(result)) {
+		for (int32_t i = 0; i < DCS_SCALER_NUM; i++) {
+			if (valid[i] && bestCost[i] < bestCost[best]) {
+				best = i;
+			}
+		}
+		mStripMode = (best == DCS_SCALER_STRIP);
+		mScaled = false;
+	}
+
+	// only the buffers of the chosen scaler are kept
+	if (SUCCESS(result) && mStripMode) {
+		delete[] mScaleBuf;
+		mScaleBuf = nullptr;
+	}
+	else if (SUCCESS(result)) {
+		delete[] mStripRing;
+		mStripRing = nullptr;
+		delete[] mStripXTab;
+		mStripXTab = nullptr;
+	}
+
+	if (SUCCESS(result)) {
+		SaveTuneCache();
+	}
+
+	delete[] pattern;
+	delete[] work;
+	delete[] ref;
+
+	return result;
+}
+
+static void GetCpuInfoValue(const char* line, const char* name, char* value, size_t size)
+{
+	const char* colon = strchr(line, ':');
+	if (value[0] != '\0' || colon == nullptr || strncmp(line, name, strlen(name)) != 0) {
+		return;
+	}
+
+	colon += strspn(colon + 1, " \t") + 1;
+	snprintf(value, size, "%s", colon);
+	value[strcspn(value, "\r\n")] = '\0';
+}
+
+void SynthesisEngine::GetTuneKey(char* key, size_t size)
+{
+	char cpu[128] = "unknown";
+	char model[128] = "", implementer[32] = "", part[32] = "", hardware[96] = "";
+	char line[256];
+
+	// x86 has "model name", arm only has the implementer/part ids or "Hardware"
+	FILE* fp = fopen("/proc/cpuinfo", "r");
+	if (fp != nullptr) {
+		while (fgets(line, sizeof(line), fp) != nullptr) {
+			GetCpuInfoValue(line, "model name", model, sizeof(model));
+			GetCpuInfoValue(line, "CPU implementer", implementer, sizeof(implementer));
+			GetCpuInfoValue(line, "CPU part", part, sizeof(part));
+			GetCpuInfoValue(line, "Hardware", hardware, sizeof(hardware));
+		}
+		fclose(fp);
+	}
+
+	if (model[0] != '\0') {
+		snprintf(cpu, sizeof(cpu), "%s", model);
+	}
+	else if (implementer[0] != '\0' && part[0] != '\0') {
+		snprintf(cpu, sizeof(cpu), "%s:%s", implementer, part);
+	}
+	else if (hardware[0] != '\0') {
+		snprintf(cpu, sizeof(cpu), "%s", hardware);
+	}
+
+	snprintf(key, size, "%s|%ux%u>%ux%u|%ux%u|%u|%u|%u", cpu,
+		mParam.inputFrontInfo.width, mParam.inputFrontInfo.height,
+		mParam.frontScaledInfo.width, mParam.frontScaledInfo.height,
+		mParam.inputBackInfo.width, mParam.inputBackInfo.height,
+		mParam.inputFrontInfo.stride, mParam.inputFrontInfo.scanline,
+		mParam.inputFrontInfo.format);
+}
+
+// cache file is one "<key>\t<scaler>" per line
+int32_t SynthesisEngine::LoadTuneCache()
+{
+	int32_t result = EMPTY_INPUT;
+	char key[256];
+	char line[320];
+
+	if (mTuneCachePath[0] == '\0') {
+		return result;
+	}
+
+	FILE* fp = fopen(mTuneCachePath, "r");
+	if (fp == nullptr) {
+		return result;
+	}
+
+	GetTuneKey(key, sizeof(key));
+	while (fgets(line, sizeof(line), fp) != nullptr) {
+		char* tab = strchr(line, '\t');
+		if (tab == nullptr) {
+			continue;
+		}
+		*tab = '\0';
+		int32_t scaler = atoi(tab + 1);
+		if (strcmp(line, key) == 0 && scaler >= 0 && scaler < DCS_SCALER_NUM) {
+			mStripMode = (scaler == DCS_SCALER_STRIP);
+			result = NO_ERROR;
+		}
+	}
+	fclose(fp);
+
+	return result;
+}
+
+int32_t SynthesisEngine::SaveTuneCache()
+{
+	char key[256];
+
+	if (mTuneCachePath[0] == '\0') {
+		return NO_ERROR;
+	}
+
+	FILE* fp = fopen(mTuneCachePath, "a");
+	if (fp == nullptr) {
+		return INVALID_PARAM;
+	}
+
+	GetTuneKey(key, sizeof(key));
+	fprintf(fp, "%s\t%d\n", key, GetScaler());
+	fclose(fp);
+
+	return NO_ERROR;
+}
+
+int32_t SynthesisEngine::SetFixedModeEnable(bool enable)
+{
+	mFixedModeEnable = enable;
+	return NO_ERROR;
+}
+
+void SynthesisEngine::UpdateFixedMode()
+{
+	// fixed modes assume packed planes, without stride or scanline padding
+	bool packed =
+		getAlignedStride(mParam.frontScaledInfo.width, mParam.inputFrontInfo.stride) ==
+			mParam.frontScaledInfo.width &&
+		getAlignedStride(mParam.frontScaledInfo.height, mParam.inputFrontInfo.scanline) ==
+			mParam.frontScaledInfo.height &&
+		getAlignedStride(mParam.inputBackInfo.width, mParam.inputBackInfo.stride) ==
+			mParam.inputBackInfo.width &&
+		getAlignedStride(mParam.inputBackInfo.height, mParam.inputBackInfo.scanline) ==
+			mParam.inputBackInfo.height;
+
+	for (int32_t state = NEEDNOT; state <= NEED_BOTH; state++) {
+		mFixedPaste[state] = packed ? FindFixedMode(mParam.inputBackInfo.width,
+			mParam.inputBackInfo.height, mParam.frontScaledInfo.width,
+			mParam.frontScaledInfo.height, mParam.inputBackInfo.format, state) : nullptr;
+	}
+}
+
 int32_t SynthesisEngine::UpdateTargetPoint(BEGIN_POINT point) {
 	mParam.targetPoint.x = point.x;
 	mParam.targetPoint.y = point.y;
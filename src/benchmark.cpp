@@ -0,0 +1,283 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// Author: Peng Hao
+// License: GPL
+//////////////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////////////
+// @file: benchmark.cpp
+// @brief: Benchmark of ProcessDownScale and ProcessSynthesis on synthetic frames.
+//      Sweeps resolution 720p..8K, PiP ratio, format, scaler, target point parity,
+//      mirror flip state, over range clamp and thread count. Every case is printed
+//      as one JSON line, so results can be diffed between versions.
+//      gbps is nominal traffic: downscale reads the front and writes the PiP,
+//      synthesis reads the PiP and writes it into the back image.
+// @usage: benchmark [--quick] [--budget-ms N] [--max-iters N] [--threads N]
+//      --threads defaults to the core count, at most BENCH_DEFAULT_MAX_THREADS, as
+//      every thread holds its own frames (about 200 MB at 8K).
+//      Exit code is 1 if any case failed.
+//////////////////////////////////////////////////////////////////////////////////////
+
+#include "DualCamSynthesis.h"
+#include "DualCamFixedMode.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+#define BENCH_DEFAULT_MAX_THREADS 8
+
+enum BENCH_STAGE {
+	BENCH_DOWNSCALE = 0,
+	BENCH_SYNTHESIS,
+};
+
+struct BENCH_CASE {
+	uint32_t stage;
+	uint32_t width;
+	uint32_t height;
+	uint32_t pipW;
+	uint32_t pipH;
+	uint32_t format;
+	uint32_t scaler;
+	int32_t mirror;
+	bool odd;
+	bool overRange;
+	bool fixedMode;
+	uint32_t threads;
+};
+
+struct BENCH_CONFIG {
+	uint32_t budgetMs;
+	uint32_t minIters;
+	uint32_t maxIters;
+};
+
+static const char* gFormatName[] = { "NV12", "NV21" };
+static const char* gScalerName[] = { "libyuv", "strip" };
+static const char* gMirrorName[] = { "none", "x_mirror", "y_flip", "both" };
+
+static uint64_t GetTimeNs()
+{
+	return chrono::duration_cast<chrono::nanoseconds>(
+		chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void FillPattern(vector<uint8_t>& buf, uint32_t seed)
+{
+	for (size_t i = 0; i < buf.size(); i++) {
+		seed = seed * 1103515245 + 12345;
+		buf[i] = (uint8_t)((i / 5 + (seed >> 16 & 0xf)) & 0xff);
+	}
+}
+
+// one engine per thread, every thread gets its own frames
+static void RunCase(const BENCH_CASE* c, const BENCH_CONFIG* config,
+	vector<uint64_t>* samples, int32_t* result)
+{
+	uint32_t size = c->width * c->height * 3 / 2;
+	vector<uint8_t> pristine(size), front(size), back(size);
+	BEGIN_POINT point;
+
+	FillPattern(pristine, 1);
+	FillPattern(back, 2);
+
+	// over range puts the PiP half outside, so FixTargetPoint() has to clamp it
+	point.x = c->overRange ? c->width - c->pipW / 2 : c->width / 3;
+	point.y = c->overRange ? c->height - c->pipH / 2 : c->height / 3;
+	point.x = c->odd ? (point.x | 1) : (point.x & ~1);
+	point.y = c->odd ? (point.y | 1) : (point.y & ~1);
+
+	SynthesisEngine SE;
+	*result = SE.SetInitParams(c->width, c->height, c->pipW, c->pipH,
+		c->width, c->height, 0, 0, point.x, point.y, c->format);
+	if (SUCCESS(*result)) {
+		*result = SE.SetStripMode(c->scaler == DCS_SCALER_STRIP);
+	}
+	if (SUCCESS(*result)) {
+		*result = SE.Initialize();
+	}
+	if (SUCCESS(*result)) {
+		*result = SE.SetMirrorFlipState(c->mirror);
+	}
+	if (SUCCESS(*result)) {
+		*result = SE.SetFixedModeEnable(c->fixedMode);
+	}
+	if (SUCCESS(*result) && c->stage == BENCH_SYNTHESIS) {
+		memcpy(front.data(), pristine.data(), size);
+		*result = SE.ProcessDownScale(front.data());
+	}
+
+	uint64_t deadline = GetTimeNs() + (uint64_t)config->budgetMs * 1000000;
+	for (uint32_t i = 0; SUCCESS(*result) && i < config->maxIters; i++) {
+		if (i >= config->minIters && GetTimeNs() > deadline) {
+			break;
+		}
+
+		uint64_t begin, end;
+		if (c->stage == BENCH_DOWNSCALE) {
+			memcpy(front.data(), pristine.data(), size);
+			begin = GetTimeNs();
+			*result = SE.ProcessDownScale(front.data());
+			end = GetTimeNs();
+		}
+		else {
+			SE.UpdateTargetPoint(point);
+			begin = GetTimeNs();
+			*result = SE.ProcessSynthesis(front.data(), back.data());
+			end = GetTimeNs();
+		}
+		samples->push_back(end - begin);
+	}
+}
+
+static int32_t ReportCase(const BENCH_CASE* c, const BENCH_CONFIG* config)
+{
+	vector<vector<uint64_t>> samples(c->threads);
+	vector<int32_t> results(c->threads, NO_ERROR);
+	vector<thread> workers;
+	vector<uint64_t> all;
+
+	uint64_t begin = GetTimeNs();
+	for (uint32_t t = 1; t < c->threads; t++) {
+		workers.push_back(thread(RunCase, c, config, &samples[t], &results[t]));
+	}
+	RunCase(c, config, &samples[0], &results[0]);
+	for (size_t t = 0; t < workers.size(); t++) {
+		workers[t].join();
+	}
+	uint64_t wall = GetTimeNs() - begin;
+
+	int32_t result = NO_ERROR;
+	for (uint32_t t = 0; t < c->threads; t++) {
+		if (!SUCCESS(results[t])) {
+			result = results[t];
+		}
+		all.insert(all.end(), samples[t].begin(), samples[t].end());
+	}
+	sort(all.begin(), all.end());
+
+	uint64_t total = 0;
+	for (size_t i = 0; i < all.size(); i++) {
+		total += all[i];
+	}
+	double mean = all.empty() ? 0 : (double)total / all.size();
+	uint64_t p50 = all.empty() ? 0 : all[all.size() * 50 / 100];
+	uint64_t p90 = all.empty() ? 0 : all[all.size() * 90 / 100];
+	uint64_t p99 = all.empty() ? 0 : all[all.size() * 99 / 100];
+	uint64_t pipSize = (uint64_t)c->pipW * c->pipH * 3 / 2;
+	uint64_t bytes = (c->stage == BENCH_DOWNSCALE) ?
+		(uint64_t)c->width * c->height * 3 / 2 + pipSize : pipSize * 2;
+
+	printf("{\"stage\":\"%s\",\"width\":%u,\"height\":%u,\"pip_w\":%u,\"pip_h\":%u,"
+		"\"format\":\"%s\",\"scaler\":\"%s\",\"mirror\":\"%s\",\"odd\":%s,"
+		"\"over_range\":%s,\"fixed_mode\":%s,\"threads\":%u,\"result\":%d,"
+		"\"iterations\":%zu,\"ns_mean\":%.0f,\"ns_p50\":%llu,\"ns_p90\":%llu,"
+		"\"ns_p99\":%llu,\"ns_max\":%llu,\"gbps\":%.3f,\"frames_per_sec\":%.1f}\n",
+		c->stage == BENCH_DOWNSCALE ? "downscale" : "synthesis",
+		c->width, c->height, c->pipW, c->pipH,
+		gFormatName[c->format], gScalerName[c->scaler], gMirrorName[c->mirror],
+		c->odd ? "true" : "false", c->overRange ? "true" : "false",
+		c->fixedMode ? "true" : "false", c->threads, result,
+		all.size(), mean, (unsigned long long)p50, (unsigned long long)p90,
+		(unsigned long long)p99, (unsigned long long)(all.empty() ? 0 : all.back()),
+		mean > 0 ? bytes / mean : 0.0,
+		wall > 0 ? all.size() * 1e9 / wall : 0.0);
+	fflush(stdout);
+
+	return result;
+}
+
+int main(int argc, char** argv) {
+	// 1. parse options
+	BENCH_CONFIG config = { 200, 5, 200 };
+	uint32_t maxThreads = min(thread::hardware_concurrency(), (uint32_t)BENCH_DEFAULT_MAX_THREADS);
+	bool quick = false;
+	uint32_t failed = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--quick") == 0) {
+			quick = true;
+		}
+		else if (strcmp(argv[i], "--budget-ms") == 0 && i + 1 < argc) {
+			config.budgetMs = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--max-iters") == 0 && i + 1 < argc) {
+			config.maxIters = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			maxThreads = atoi(argv[++i]);
+		}
+		else {
+			fprintf(stderr, "usage: %s [--quick] [--budget-ms N] [--max-iters N] [--threads N]\n"
+				"  --threads N  max threads, default is the core count but at most %d\n",
+				argv[0], BENCH_DEFAULT_MAX_THREADS);
+			return 1;
+		}
+	}
+	maxThreads = (maxThreads < 1) ? 1 : maxThreads;
+
+	// 2. sweep dimensions
+	const uint32_t resolution[][2] = {
+		{ 1280, 720 }, { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 }, { 7680, 4320 },
+	};
+	const uint32_t ratio[] = { 5, 4, 3 };    //PiP is 1/ratio of the back image
+	uint32_t resolutionNum = quick ? 2 : sizeof(resolution) / sizeof(resolution[0]);
+	uint32_t ratioNum = quick ? 1 : sizeof(ratio) / sizeof(ratio[0]);
+	vector<uint32_t> threads(1, 1);
+	if (maxThreads > 1) {
+		threads.push_back(maxThreads);
+	}
+
+	// 3. run, downscale does not depend on target point or mirror
+	for (uint32_t r = 0; r < resolutionNum; r++) {
+		for (uint32_t k = 0; k < ratioNum; k++) {
+			for (uint32_t format = DCS_YUV420NV12; format < DCS_NOT_SUPPORT; format++) {
+				for (size_t t = 0; t < threads.size(); t++) {
+					BENCH_CASE c;
+					c.width = resolution[r][0];
+					c.height = resolution[r][1];
+					c.pipW = (c.width / ratio[k]) & ~1;
+					c.pipH = (c.height / ratio[k]) & ~1;
+					c.format = format;
+					c.threads = threads[t];
+					c.mirror = NEEDNOT;
+					c.odd = false;
+					c.overRange = false;
+					c.fixedMode = false;
+					fprintf(stderr, "%ux%u pip %ux%u %s threads %u\n", c.width, c.height,
+						c.pipW, c.pipH, gFormatName[format], c.threads);
+
+					c.stage = BENCH_DOWNSCALE;
+					for (c.scaler = DCS_SCALER_LIBYUV; c.scaler < DCS_SCALER_NUM; c.scaler++) {
+						failed += SUCCESS(ReportCase(&c, &config)) ? 0 : 1;
+					}
+
+					c.stage = BENCH_SYNTHESIS;
+					c.scaler = DCS_SCALER_LIBYUV;
+					bool hasFixed = FindFixedMode(c.width, c.height, c.pipW, c.pipH,
+						format, NEEDNOT) != nullptr;
+					for (c.mirror = NEEDNOT; c.mirror <= NEED_BOTH; c.mirror++) {
+						for (int32_t odd = 0; odd < 2; odd++) {
+							for (int32_t over = 0; over < 2; over++) {
+								for (int32_t fixed = 0; fixed < (hasFixed ? 2 : 1); fixed++) {
+									c.odd = (odd == 1);
+									c.overRange = (over == 1);
+									c.fixedMode = (fixed == 1);
+									failed += SUCCESS(ReportCase(&c, &config)) ? 0 : 1;
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	if (failed > 0) {
+		fprintf(stderr, "%u cases failed\n", failed);
+	}
+	return (failed > 0) ? 1 : 0;
+}
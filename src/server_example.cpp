@@ -0,0 +1,120 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// Author: Peng Hao
+// License: GPL
+//////////////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////////////
+// @file: server_example.cpp
+// @brief: A loopback test of FrameServer on one Linux box. Capture and encoder are
+//      forked child processes which share the rings with the server process.
+//////////////////////////////////////////////////////////////////////////////////////
+
+#include "DualCamFrameServer.h"
+
+#include <iostream>
+#include <unistd.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+#define FRAME_NUM 60
+#define FRONT_Y 200
+#define BACK_Y 30
+
+static int32_t RunCapture(DCS_SERVER_FDS fds)
+{
+	FrameServer client;
+	DUAL_CAM_SYNTHESIS_PARAM param;
+	client.Attach(fds);
+	client.GetParams(&param);
+
+	int32_t sent = 0;
+	while (sent < FRAME_NUM) {
+		uint8_t* back = client.AcquireBackSlot();
+		if (back == nullptr) {
+			usleep(1000);
+			continue;
+		}
+		// front runs at half the back frame rate
+		uint8_t* front = (sent % 2 == 0) ? client.AcquireFrontSlot() : nullptr;
+		if (front != nullptr) {
+			memset(front, FRONT_Y, param.inputFrontInfo.width * param.inputFrontInfo.height);
+			memset(front + param.inputFrontInfo.width * param.inputFrontInfo.height, 128,
+				param.inputFrontInfo.width * param.inputFrontInfo.height / 2);
+			client.SubmitFront(sent * 33333);
+		}
+		memset(back, BACK_Y, param.inputBackInfo.width * param.inputBackInfo.height);
+		memset(back + param.inputBackInfo.width * param.inputBackInfo.height, 128,
+			param.inputBackInfo.width * param.inputBackInfo.height / 2);
+		client.SubmitBack(sent * 33333);
+		sent++;
+		usleep(2000);
+	}
+
+	return 0;
+}
+
+static int32_t RunEncoder(DCS_SERVER_FDS fds)
+{
+	FrameServer client;
+	DUAL_CAM_SYNTHESIS_PARAM param;
+	client.Attach(fds);
+	client.GetParams(&param);
+
+	int32_t received = 0, withPip = 0;
+	uint64_t timestamp;
+	while (received < FRAME_NUM) {
+		uint8_t* out = client.AcquireOutput(1000, &timestamp);
+		if (out == nullptr) {
+			cout << " encoder timeout" << endl;
+			return 1;
+		}
+		uint32_t x = param.targetPoint.x, y = param.targetPoint.y;
+		if (out[y * param.inputBackInfo.width + x] == FRONT_Y) {
+			withPip++;
+		}
+		client.ReleaseOutput();
+		received++;
+	}
+	cout << " encoder received " << received << " frames, " << withPip << " with PiP" << endl;
+
+	return (withPip == received) ? 0 : 1;
+}
+
+int main() {
+	// 1. create and initialize the engine as usual
+	int32_t w = 1280;
+	int32_t h = 720;
+	SynthesisEngine SE;
+	int32_t result = SE.SetInitParams(w, h, w / 4, h / 4, w, h, 0, 0, 64, 64, DCS_YUV420NV12);
+	result = SE.Initialize();
+	cout << " SE.Initialize " << result << endl;
+
+	// 2. put the engine behind a frame server
+	FrameServer server;
+	DCS_SERVER_FDS fds;
+	result = server.Create(&SE, 4);
+	cout << " server.Create " << result << endl;
+	server.GetFds(&fds);
+
+	// 3. capture and encoder inherit the fds, other processes could get them by SCM_RIGHTS
+	pid_t capture = fork();
+	if (capture == 0) {
+		_exit(RunCapture(fds));
+	}
+	pid_t encoder = fork();
+	if (encoder == 0) {
+		_exit(RunEncoder(fds));
+	}
+
+	// 4. composite until the encoder is done
+	int32_t status = 0;
+	while (waitpid(encoder, &status, WNOHANG) == 0) {
+		server.ProcessOnce(100);
+	}
+	int32_t encoderFailed = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+	cout << " encoder exit " << WEXITSTATUS(status) << endl;
+	waitpid(capture, &status, 0);
+
+	return encoderFailed ? 1 : 0;
+}
@@ -0,0 +1,490 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// Author: Peng Hao
+// License: GPL
+//////////////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////////////
+// @file: DualCamTest.cpp
+// @brief: Checks of the optional fast paths against the generic ones, run by ctest.
+//      strip: strip scaler output is within DCS_TUNE_MAX_DIFF of libyuv.
+//      fixed: fixed mode paste is bit exact with the generic paste.
+//      pairing: PairingScheduler picks, drops and releases the expected frames.
+//      multi: MultiSynthesisEngine pastes the PiP into every back, front untouched.
+//      display: display output is the libyuv conversion of the composited back.
+//////////////////////////////////////////////////////////////////////////////////////
+
+#include "DualCamSynthesis.h"
+#include "DualCamFixedMode.h"
+#include "DualCamMultiSynthesis.h"
+#include "DualCamPairing.h"
+#include "libyuv.h"
+
+#include <vector>
+
+using namespace std;
+
+static void FillPattern(vector<uint8_t>& buf, uint32_t seed)
+{
+	// gradient wraps every few hundred samples, so neighbours may differ by ~255
+	for (size_t i = 0; i < buf.size(); i++) {
+		seed = seed * 1103515245 + 12345;
+		buf[i] = (uint8_t)((i / 7 + (seed >> 16 & 0x1f)) & 0xff);
+	}
+}
+
+static int32_t TestStrip(uint32_t srcW, uint32_t srcH, uint32_t dstW, uint32_t dstH,
+	uint32_t format)
+{
+	int32_t result = NO_ERROR;
+	uint32_t srcSize = srcW * srcH * 3 / 2;
+	uint32_t dstSize = dstW * dstH * 3 / 2;
+	vector<uint8_t> pristine(srcSize), ref(srcSize), strip(srcSize);
+	vector<uint8_t> stripY(srcW * srcH), stripUV(srcW * srcH / 2);
+	SynthesisEngine libyuvSE, stripSE;
+
+	FillPattern(pristine, 1);
+	ref = pristine;
+	strip = pristine;
+	memcpy(stripY.data(), pristine.data(), srcW * srcH);
+	memcpy(stripUV.data(), pristine.data() + srcW * srcH, srcW * srcH / 2);
+
+	result = libyuvSE.SetInitParams(srcW, srcH, dstW, dstH, srcW, srcH, 0, 0, 0, 0, format);
+	if (SUCCESS(result)) {
+		result = stripSE.SetInitParams(srcW, srcH, dstW, dstH, srcW, srcH, 0, 0, 0, 0, format);
+	}
+	if (SUCCESS(result)) {
+		result = stripSE.SetStripMode(true);
+	}
+	if (SUCCESS(result)) {
+		result = libyuvSE.Initialize();
+	}
+	if (SUCCESS(result)) {
+		result = stripSE.Initialize();
+	}
+	if (SUCCESS(result)) {
+		result = libyuvSE.ProcessDownScale(ref.data());
+	}
+	if (SUCCESS(result)) {
+		result = stripSE.ProcessDownScale(strip.data());
+	}
+	if (SUCCESS(result)) {
+		result = stripSE.ProcessDownScale(stripY.data(), stripUV.data());
+	}
+
+	int32_t maxDiff = 0;
+	for (uint32_t i = 0; SUCCESS(result) && i < dstSize; i++) {
+		int32_t diff = abs((int32_t)strip[i] - (int32_t)ref[i]);
+		int32_t splitDiff = (i < dstW * dstH) ?
+			abs((int32_t)stripY[i] - (int32_t)ref[i]) :
+			abs((int32_t)stripUV[i - dstW * dstH] - (int32_t)ref[i]);
+		maxDiff = (diff > maxDiff) ? diff : maxDiff;
+		maxDiff = (splitDiff > maxDiff) ? splitDiff : maxDiff;
+	}
+	if (SUCCESS(result) && maxDiff > DCS_TUNE_MAX_DIFF) {
+		result = INVALID_PARAM;
+	}
+
+	printf("strip %ux%u -> %ux%u format %u max diff %d: %s\n", srcW, srcH, dstW, dstH,
+		format, maxDiff, SUCCESS(result) ? "ok" : "FAILED");
+	return result;
+}
+
+static int32_t TestFixedMode(uint32_t backW, uint32_t backH, uint32_t pipW, uint32_t pipH,
+	uint32_t format, int32_t mirror, uint32_t x, uint32_t y)
+{
+	int32_t result = NO_ERROR;
+	uint32_t size = backW * backH * 3 / 2;
+	vector<uint8_t> front(size), back(size), output[2];
+
+	FillPattern(front, 1);
+	FillPattern(back, 2);
+
+	// a missing registry entry would silently compare the generic paste with itself
+	if (FindFixedMode(backW, backH, pipW, pipH, format, mirror) == nullptr) {
+		result = INVALID_PARAM;
+	}
+
+	for (int32_t fixed = 0; SUCCESS(result) && fixed < 2; fixed++) {
+		SynthesisEngine SE;
+		vector<uint8_t> scaled = front;
+		output[fixed] = back;
+		result = SE.SetInitParams(backW, backH, pipW, pipH, backW, backH, 0, 0, x, y, format);
+		if (SUCCESS(result)) {
+			result = SE.Initialize();
+		}
+		if (SUCCESS(result)) {
+			result = SE.SetMirrorFlipState(mirror);
+		}
+		if (SUCCESS(result)) {
+			result = SE.SetFixedModeEnable(fixed == 1);
+		}
+		if (SUCCESS(result)) {
+			result = SE.ProcessDownScale(scaled.data());
+		}
+		if (SUCCESS(result)) {
+			result = SE.ProcessSynthesis(scaled.data(), output[fixed].data());
+		}
+	}
+
+	if (SUCCESS(result) && output[0] != output[1]) {
+		result = INVALID_PARAM;
+	}
+
+	printf("fixed %ux%u pip %ux%u format %u mirror %d at (%u,%u): %s\n", backW, backH,
+		pipW, pipH, format, mirror, x, y, SUCCESS(result) ? "ok" : "FAILED");
+	return result;
+}
+
+static IMG_INFO GetInfo(uint32_t width, uint32_t height)
+{
+	IMG_INFO info = { width, height, width * height * 3 / 2, 0, 0, DCS_YUV420NV12 };
+	return info;
+}
+
+static int32_t TestMultiSynthesis()
+{
+	int32_t result = NO_ERROR;
+	const uint32_t frontW = 1280, frontH = 720, frontLuma = 200, backLuma = 30;
+	const uint32_t output[][6] = {
+		// back w, back h, PiP w, PiP h, x, y
+		{ 1920, 1080, 384, 216, 100, 100 },
+		{ 640, 360, 128, 72, 10, 20 },
+	};
+	const uint32_t outputNum = sizeof(output) / sizeof(output[0]);
+	vector<uint8_t> front(frontW * frontH * 3 / 2, 128), pattern(front.size());
+	vector<vector<uint8_t>> back(outputNum);
+	void* backData[outputNum];
+	MultiSynthesisEngine MSE;
+	bool ok = true;
+
+	memset(front.data(), frontLuma, frontW * frontH);
+	FillPattern(pattern, 3);
+
+	result = MSE.SetFrontParams(GetInfo(frontW, frontH));
+	for (uint32_t i = 0; i < outputNum && SUCCESS(result); i++) {
+		BEGIN_POINT point = { output[i][4], output[i][5], false, false };
+		back[i].assign(output[i][0] * output[i][1] * 3 / 2, 128);
+		memset(back[i].data(), backLuma, output[i][0] * output[i][1]);
+		backData[i] = back[i].data();
+		result = MSE.AddOutput(GetInfo(output[i][2], output[i][3]),
+			GetInfo(output[i][0], output[i][1]), point);
+	}
+	if (SUCCESS(result)) {
+		result = MSE.Initialize();
+	}
+	if (SUCCESS(result)) {
+		ok = ok && MSE.Initialize() == ORDER_ERROR;
+		result = MSE.ProcessSynthesis(front.data(), backData, outputNum);
+	}
+
+	// flat front: inside the PiP rect is front luma, everything else is untouched
+	for (uint32_t i = 0; i < outputNum && SUCCESS(result); i++) {
+		for (uint32_t y = 0; y < output[i][1]; y++) {
+			for (uint32_t x = 0; x < output[i][0]; x++) {
+				bool inPip = x >= output[i][4] && x < output[i][4] + output[i][2] &&
+					y >= output[i][5] && y < output[i][5] + output[i][3];
+				ok = ok && back[i][y * output[i][0] + x] == (inPip ? frontLuma : backLuma);
+			}
+		}
+	}
+
+	if (SUCCESS(result)) {
+		vector<uint8_t> frontCopy = pattern;
+		result = MSE.ProcessSynthesis(pattern.data(), backData, outputNum);
+		ok = ok && pattern == frontCopy;
+	}
+
+	// Deinit() forgets the outputs, a new AddOutput() starts from scratch
+	if (SUCCESS(result)) {
+		MSE.Deinit();
+		BEGIN_POINT point = { 0, 0, false, false };
+		ok = ok && MSE.AddOutput(GetInfo(64, 36), GetInfo(320, 180), point) == ORDER_ERROR;
+		result = MSE.SetFrontParams(GetInfo(frontW, frontH));
+	}
+	if (SUCCESS(result)) {
+		BEGIN_POINT point = { 0, 0, false, false };
+		vector<uint8_t> small(320 * 180 * 3 / 2, 0);
+		void* smallData = small.data();
+		result = MSE.AddOutput(GetInfo(64, 36), GetInfo(320, 180), point);
+		if (SUCCESS(result)) {
+			result = MSE.Initialize();
+		}
+		if (SUCCESS(result)) {
+			ok = ok && MSE.ProcessSynthesis(front.data(), backData, outputNum) == INVALID_PARAM;
+			result = MSE.ProcessSynthesis(front.data(), &smallData, 1);
+		}
+		ok = ok && small[0] == frontLuma;
+	}
+
+	if (SUCCESS(result) && !ok) {
+		result = INVALID_PARAM;
+	}
+
+	printf("multi synthesis: %s\n", SUCCESS(result) ? "ok" : "FAILED");
+	return result;
+}
+
+static void ToDisplay(vector<uint8_t>& frame, uint32_t w, uint32_t h, uint32_t format,
+	uint32_t displayFormat, vector<uint8_t>* display)
+{
+	// libyuv names ARGB by word order, ABGR is R,G,B,A in memory
+	const uint8_t* y = frame.data();
+	const uint8_t* uv = frame.data() + w * h;
+	display->resize(w * h * 4);
+	if (format == DCS_YUV420NV12 && displayFormat == DCS_DISPLAY_RGBA) {
+		libyuv::NV12ToABGR(y, w, uv, w, display->data(), w * 4, w, h);
+	}
+	else if (format == DCS_YUV420NV12) {
+		libyuv::NV12ToARGB(y, w, uv, w, display->data(), w * 4, w, h);
+	}
+	else if (displayFormat == DCS_DISPLAY_RGBA) {
+		libyuv::NV21ToABGR(y, w, uv, w, display->data(), w * 4, w, h);
+	}
+	else {
+		libyuv::NV21ToARGB(y, w, uv, w, display->data(), w * 4, w, h);
+	}
+}
+
+static int32_t TestDisplay(uint32_t format, uint32_t displayFormat, int32_t mirror)
+{
+	int32_t result = NO_ERROR;
+	const uint32_t w = 640, h = 360, pipW = 128, pipH = 72;
+	BEGIN_POINT point[2] = { { 100, 50, false, false }, { 300, 200, false, false } };
+	vector<uint8_t> front(w * h * 3 / 2), pristine(w * h * 3 / 2), display(w * h * 4, 0);
+	vector<uint8_t> scaled, refBack, refDisplay;
+	SynthesisEngine SE;
+	bool ok = true;
+
+	FillPattern(front, 1);
+	FillPattern(pristine, 2);
+	vector<uint8_t> back = pristine;
+
+	result = SE.SetInitParams(w, h, pipW, pipH, w, h, 0, 0, point[0].x, point[0].y, format);
+	if (SUCCESS(result)) {
+		result = SE.Initialize();
+	}
+	if (SUCCESS(result)) {
+		result = SE.SetMirrorFlipState(mirror);
+	}
+	if (SUCCESS(result)) {
+		result = SE.SetDisplayParams(displayFormat, 0);
+	}
+	if (SUCCESS(result)) {
+		scaled = front;
+		result = SE.ProcessDownScale(scaled.data());
+	}
+
+	// nothing saved yet, a partial update has no background to start from
+	if (SUCCESS(result)) {
+		vector<uint8_t> backCopy = back;
+		ok = ok && SE.ProcessSynthesisDisplay(scaled.data(), backCopy.data(),
+			display.data(), false) == ORDER_ERROR;
+	}
+
+	// full frame, then a partial update which moves the PiP over the same back
+	for (int32_t i = 0; i < 2 && SUCCESS(result); i++) {
+		// reference: the untouched back with only the current PiP
+		vector<uint8_t> pasted = pristine;
+		SynthesisEngine refSE;
+		result = refSE.SetInitParams(w, h, pipW, pipH, w, h, 0, 0,
+			point[i].x, point[i].y, format);
+		if (SUCCESS(result)) {
+			result = refSE.Initialize();
+		}
+		if (SUCCESS(result)) {
+			result = refSE.SetMirrorFlipState(mirror);
+		}
+		if (SUCCESS(result)) {
+			refBack = front;
+			result = refSE.ProcessDownScale(refBack.data());
+		}
+		if (SUCCESS(result)) {
+			result = refSE.ProcessSynthesis(refBack.data(), pasted.data());
+		}
+		if (SUCCESS(result) && i == 1) {
+			result = SE.UpdateTargetPoint(point[i]);
+		}
+		if (SUCCESS(result)) {
+			result = SE.ProcessSynthesisDisplay(scaled.data(), back.data(),
+				display.data(), i == 0);
+		}
+		if (SUCCESS(result)) {
+			ToDisplay(pasted, w, h, format, displayFormat, &refDisplay);
+			ok = ok && display == refDisplay;
+		}
+	}
+
+	if (SUCCESS(result) && !ok) {
+		result = INVALID_PARAM;
+	}
+
+	printf("display format %u display %u mirror %d: %s\n", format, displayFormat,
+		mirror, SUCCESS(result) ? "ok" : "FAILED");
+	return result;
+}
+
+struct PAIRING_RELEASE {
+	uint64_t timestamp;
+	bool dropped;
+};
+
+static vector<PAIRING_RELEASE> gPairingRelease;
+
+static void PairingRelease(void* data, uint64_t timestamp, bool dropped, void* userData)
+{
+	(void)data;
+	(void)userData;
+	PAIRING_RELEASE entry = { timestamp, dropped };
+	gPairingRelease.push_back(entry);
+}
+
+// every released timestamp once, in this order, and nothing else
+static bool CheckPairingRelease(const PAIRING_RELEASE* expect, size_t num)
+{
+	bool match = gPairingRelease.size() == num;
+	for (size_t i = 0; match && i < num; i++) {
+		match = gPairingRelease[i].timestamp == expect[i].timestamp &&
+			gPairingRelease[i].dropped == expect[i].dropped;
+	}
+	gPairingRelease.clear();
+	return match;
+}
+
+static int32_t TestPairing()
+{
+	int32_t result = NO_ERROR;
+	const uint32_t w = 320, h = 240, x = 16, y = 16;
+	const uint8_t frontLuma[] = { 10, 40, 70, 100, 130, 160 };
+	vector<vector<uint8_t>> front(sizeof(frontLuma)), back(6, vector<uint8_t>(w * h * 3 / 2, 0));
+	SynthesisEngine SE;
+	PairingScheduler PS;
+	DUAL_CAM_PAIRING_PARAM param = { 10000, 50000 };
+	DUAL_CAM_PAIRING_STATS stats;
+	void* out = nullptr;
+	uint64_t timestamp = 0;
+	bool ok = true;
+
+	// flat fronts, so the PiP luma tells which front was composited
+	for (size_t i = 0; i < front.size(); i++) {
+		front[i].assign(w * h * 3 / 2, 128);
+		memset(front[i].data(), frontLuma[i], w * h);
+	}
+
+	result = SE.SetInitParams(w, h, w / 5, h / 5, w, h, 0, 0, x, y, DCS_YUV420NV12);
+	if (SUCCESS(result)) {
+		result = SE.Initialize();
+	}
+	if (SUCCESS(result)) {
+		result = PS.Initialize(&SE, param, PairingRelease, nullptr);
+	}
+	gPairingRelease.clear();
+
+	// 1. nearest front within tolerance wins, the older one is dropped
+	if (SUCCESS(result)) {
+		PS.PushFront(front[0].data(), 0);
+		PS.PushFront(front[1].data(), 33000);
+		PS.PushBack(back[0].data(), 40000);
+		result = PS.ProcessNext(&out, &timestamp);
+		const PAIRING_RELEASE expect[] = { { 0, true }, { 33000, false } };
+		ok = ok && CheckPairingRelease(expect, 2) && out == back[0].data() &&
+			timestamp == 40000 && back[0][y * w + x] == frontLuma[1];
+	}
+
+	// 2. every front is older than back - tolerance: the newest one is still newer
+	// than the last scaled front, so it is used instead of the cached one
+	if (SUCCESS(result)) {
+		PS.PushFront(front[2].data(), 66000);
+		PS.PushBack(back[1].data(), 200000);
+		result = PS.ProcessNext(&out, &timestamp);
+		const PAIRING_RELEASE expect[] = { { 66000, false } };
+		ok = ok && CheckPairingRelease(expect, 1) && out == back[1].data() &&
+			back[1][y * w + x] == frontLuma[2];
+	}
+
+	// 3. a front beyond back + tolerance waits, the last scaled front is reused
+	if (SUCCESS(result)) {
+		PS.PushFront(front[3].data(), 300000);
+		PS.PushBack(back[2].data(), 233000);
+		result = PS.ProcessNext(&out, &timestamp);
+		ok = ok && CheckPairingRelease(nullptr, 0) && out == back[2].data() &&
+			back[2][y * w + x] == frontLuma[2];
+	}
+
+	// 4. back frames older than newest - latencyBudget are dropped
+	if (SUCCESS(result)) {
+		PS.PushBack(back[3].data(), 240000);
+		PS.PushBack(back[4].data(), 300000);
+		result = PS.ProcessNext(&out, &timestamp);
+		const PAIRING_RELEASE expect[] = { { 240000, true }, { 300000, false } };
+		ok = ok && CheckPairingRelease(expect, 2) && out == back[4].data() &&
+			timestamp == 300000 && back[4][y * w + x] == frontLuma[3];
+	}
+
+	if (SUCCESS(result)) {
+		result = PS.GetStats(&stats);
+		ok = ok && stats.frontQueueDepth == 0 && stats.backQueueDepth == 0 &&
+			stats.frontDropped == 1 && stats.backDropped == 1 && stats.paired == 2 &&
+			stats.frontStale == 1 && stats.frontReused == 1 && stats.noFront == 0;
+	}
+
+	// 5. a back which can not be composited goes back through the callback
+	if (SUCCESS(result)) {
+		SE.Deinit();
+		PS.PushFront(front[4].data(), 333000);
+		PS.PushBack(back[5].data(), 333000);
+		ok = ok && !SUCCESS(PS.ProcessNext(&out, &timestamp)) && out == nullptr;
+		const PAIRING_RELEASE expect[] = { { 333000, true }, { 333000, true } };
+		ok = ok && CheckPairingRelease(expect, 2);
+	}
+
+	if (SUCCESS(result) && !ok) {
+		result = INVALID_PARAM;
+	}
+
+	printf("pairing: %s\n", SUCCESS(result) ? "ok" : "FAILED");
+	return result;
+}
+
+int main() {
+	const uint32_t stripSize[][4] = {
+		{ 1920, 1080, 384, 216 }, { 1920, 1080, 640, 360 }, { 1920, 1080, 960, 540 },
+		{ 1280, 720, 1000, 562 }, { 1280, 720, 426, 240 }, { 3840, 2160, 1280, 720 },
+	};
+	uint32_t failed = 0;
+
+	for (size_t i = 0; i < sizeof(stripSize) / sizeof(stripSize[0]); i++) {
+		for (uint32_t format = DCS_YUV420NV12; format < DCS_NOT_SUPPORT; format++) {
+			failed += SUCCESS(TestStrip(stripSize[i][0], stripSize[i][1],
+				stripSize[i][2], stripSize[i][3], format)) ? 0 : 1;
+		}
+	}
+
+	// built-in fixed modes, PiP is 1/5 of the back image
+	const uint32_t fixedSize[][2] = { { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 } };
+	for (size_t i = 0; i < sizeof(fixedSize) / sizeof(fixedSize[0]); i++) {
+		uint32_t backW = fixedSize[i][0];
+		uint32_t backH = fixedSize[i][1];
+		for (uint32_t format = DCS_YUV420NV12; format < DCS_NOT_SUPPORT; format++) {
+			for (int32_t mirror = NEEDNOT; mirror <= NEED_BOTH; mirror++) {
+				for (uint32_t parity = 0; parity < 4; parity++) {
+					failed += SUCCESS(TestFixedMode(backW, backH, backW / 5, backH / 5,
+						format, mirror, backW / 3 + parity % 2, backH / 3 + parity / 2)) ? 0 : 1;
+				}
+			}
+		}
+	}
+
+	failed += SUCCESS(TestPairing()) ? 0 : 1;
+	failed += SUCCESS(TestMultiSynthesis()) ? 0 : 1;
+
+	for (uint32_t format = DCS_YUV420NV12; format < DCS_NOT_SUPPORT; format++) {
+		for (uint32_t display = DCS_DISPLAY_RGBA; display < DCS_DISPLAY_NOT_SUPPORT; display++) {
+			for (int32_t mirror = NEEDNOT; mirror <= NEED_BOTH; mirror++) {
+				failed += SUCCESS(TestDisplay(format, display, mirror)) ? 0 : 1;
+			}
+		}
+	}
+
+	printf("%u failed\n", failed);
+	return (failed > 0) ? 1 : 0;
+}